@@ -0,0 +1,513 @@
+#include "session-bench.h"
+
+#include "async-logger.h"
+#include "session-environment.h"
+#include "window-manager.h"
+#include "proc-reaper.h"
+#include "metrics-server.h"
+#include "graceful-modman.h"
+#include "power-source-watcher.h"
+
+#include <graceful/globals.h>
+#include <graceful/log.h>
+
+#include <QtTest>
+#include <XdgAutoStart>
+#include <XdgDesktopFile>
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QElapsedTimer>
+
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SESSION_STARTUP_TIMEOUT_MS  (60 * 1000)
+// modules keep starting for a while after the startup phases ended
+#define SESSION_SETTLE_MS           2000
+// the last line StartupTimings::dump() logs
+#define STARTUP_DONE_LINE           "resident memory after startup"
+#define METRICS_CLIENT_TIMEOUT_MS   5000
+// past the debounce of PowerSourceWatcher
+#define POWER_CHANGE_TIMEOUT_MS     5000
+
+/**
+ * @brief VmRSS of pid in kB, -1 if unknown
+ */
+static qint64 resident_memory(qint64 pid)
+{
+    QFile status(QSL("/proc/%1/status").arg(pid));
+    if (!status.open(QIODevice::ReadOnly))
+        return -1;
+
+    while (!status.atEnd()) {
+        const QByteArray line = status.readLine();
+        if (line.startsWith("VmRSS:"))
+            return line.mid(6).trimmed().split(' ').first().toLongLong();
+    }
+    return -1;
+}
+
+/**
+ * @brief a power supply in a fake sysfs tree, one file per attribute
+ */
+static bool write_supply(const QString &root, const QString &name, const QMap<QString, QString> &attributes)
+{
+    const QString dir = root + QSL("/class/power_supply/") + name;
+    if (!QDir().mkpath(dir))
+        return false;
+
+    for (auto it = attributes.constBegin(); it != attributes.constEnd(); ++it) {
+        QFile file(dir + QLatin1Char('/') + it.key());
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+        file.write(it.value().toLatin1() + '\n');
+    }
+    return true;
+}
+
+void SessionBench::initTestCase()
+{
+    QVERIFY(mHome.isValid());
+
+    // the helpers read the configuration of the bench home, not the user's
+    QDir().mkpath(mHome.filePath(QSL("config/graceful")));
+    QDir().mkpath(mHome.filePath(QSL("config/autostart")));
+    QDir().mkpath(mHome.filePath(QSL("xdg")));
+    qputenv("XDG_CONFIG_HOME", QFile::encodeName(mHome.filePath(QSL("config"))));
+    qputenv("XDG_CONFIG_DIRS", QFile::encodeName(mHome.filePath(QSL("xdg"))));
+}
+
+void SessionBench::programLookup_data()
+{
+    QTest::addColumn<int>("dirs");
+    QTest::addColumn<bool>("found");
+
+    QTest::newRow("8 dirs, found in the last") << 8 << true;
+    QTest::newRow("8 dirs, missing") << 8 << false;
+    QTest::newRow("32 dirs, found in the last") << 32 << true;
+    QTest::newRow("32 dirs, missing") << 32 << false;
+}
+
+void SessionBench::programLookup()
+{
+    QFETCH(int, dirs);
+    QFETCH(bool, found);
+
+    // a PATH of empty directories, the program is in the last one
+    QByteArray path;
+    for (int i = 0; i < dirs; ++i) {
+        const QString dir = mHome.filePath(QSL("path/%1").arg(i));
+        QDir().mkpath(dir);
+        if (!path.isEmpty())
+            path += ':';
+        path += QFile::encodeName(dir);
+    }
+    QFile program(mHome.filePath(QSL("path/%1/bench-program").arg(dirs - 1)));
+    QVERIFY(program.open(QIODevice::WriteOnly));
+    program.close();
+    program.setPermissions(QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+
+    const QByteArray oldPath = qgetenv("PATH");
+    qputenv("PATH", path);
+    const QString name = found ? QSL("bench-program") : QSL("bench-missing");
+    bool result = false;
+    QBENCHMARK {
+        result = ::findProgram(name);
+    }
+    qputenv("PATH", oldPath);
+    QCOMPARE(result, found);
+}
+
+void SessionBench::windowManagerList()
+{
+    const QString conf = mHome.filePath(QSL("config/graceful/windowmanagers.conf"));
+    QFile::remove(conf);
+    QVERIFY(QFile::copy(QSL(WINDOWMANAGERS_CONF), conf));
+
+    int count = 0;
+    QBENCHMARK {
+        count = getWindowManagerList(false).size();
+    }
+    QVERIFY(count > 0);
+}
+
+void SessionBench::setEnvironment_data()
+{
+    QTest::addColumn<bool>("prepend");
+    QTest::addColumn<QByteArray>("value");
+
+    QTest::newRow("set plain") << false << QByteArray("/usr/share/graceful");
+    QTest::newRow("set expanded") << false << QByteArray("$HOME/.local/share:${XDG_CONFIG_HOME}/graceful:~/bin");
+    QTest::newRow("prepend expanded") << true << QByteArray("$HOME/.local/share:${XDG_CONFIG_HOME}/graceful:~/bin");
+}
+
+void SessionBench::setEnvironment()
+{
+    QFETCH(bool, prepend);
+    QFETCH(QByteArray, value);
+
+    // prepending grows the variable, every iteration starts from the same one
+    QBENCHMARK {
+        if (prepend) {
+            qputenv("GRACEFUL_BENCH", "/usr/share");
+            graceful_setenv_prepend("GRACEFUL_BENCH", value);
+        } else {
+            graceful_setenv("GRACEFUL_BENCH", value);
+        }
+    }
+    QVERIFY(!qgetenv("GRACEFUL_BENCH").contains('$'));
+    qunsetenv("GRACEFUL_BENCH");
+}
+
+void SessionBench::writeAutostart(int n)
+{
+    QDir dir(mHome.filePath(QSL("config/autostart")));
+    for (const QString& name : dir.entryList(QDir::Files))
+        dir.remove(name);
+
+    for (int i = 0; i < n; ++i) {
+        QFile file(dir.filePath(QSL("bench-%1.desktop").arg(i)));
+        if (!file.open(QIODevice::WriteOnly))
+            return;
+        file.write(QSL("[Desktop Entry]\n"
+                       "Type=Application\n"
+                       "Name=Bench %1\n"
+                       "Exec=sleep %1\n"
+                       "X-Graceful-Module=%2\n").arg(i).arg(i % 2 ? QSL("true") : QSL("false")).toUtf8());
+    }
+}
+
+void SessionBench::autostartList_data()
+{
+    QTest::addColumn<int>("files");
+
+    QTest::newRow("10 files") << 10;
+    QTest::newRow("100 files") << 100;
+}
+
+void SessionBench::autostartList()
+{
+    QFETCH(int, files);
+    writeAutostart(files);
+
+    int count = 0;
+    QBENCHMARK {
+        count = XdgAutoStart::desktopFileList().size();
+    }
+    QCOMPARE(count, files);
+}
+
+void SessionBench::expandExec_data()
+{
+    QTest::addColumn<bool>("cached");
+
+    QTest::newRow("expanded on every start") << false;
+    QTest::newRow("cached in the module") << true;
+}
+
+void SessionBench::expandExec()
+{
+    QFETCH(bool, cached);
+
+    const QString path = mHome.filePath(QSL("bench-exec.desktop"));
+    QFile out(path);
+    QVERIFY(out.open(QIODevice::WriteOnly));
+    out.write("[Desktop Entry]\nType=Application\nName=Bench\n"
+              "Exec=env GRACEFUL_BENCH=$HOME/bench sh -c \"exit 0\" %U\n");
+    out.close();
+
+    XdgDesktopFile file;
+    QVERIFY(file.load(path));
+
+    // a full start of the module, the expansion is the difference of the rows
+    GracefulModule module(file);
+    QBENCHMARK {
+        if (!cached)
+            module.resetExecArgs();
+        module.start();
+        module.waitForFinished();
+    }
+    QCOMPARE(module.program(), QSL("env"));
+    QCOMPARE(module.exitCode(), 0);
+}
+
+void SessionBench::reaperChildren_data()
+{
+    QTest::addColumn<bool>("scan");
+    QTest::addColumn<int>("children");
+
+    QTest::newRow("children files, 10 children") << false << 10;
+    QTest::newRow("process scan, 10 children") << true << 10;
+    QTest::newRow("children files, 100 children") << false << 100;
+    QTest::newRow("process scan, 100 children") << true << 100;
+}
+
+void SessionBench::reaperChildren()
+{
+    QFETCH(bool, scan);
+    QFETCH(int, children);
+
+    // what ProcReaper::stop() looks for at logout
+    QList<QProcess*> processes;
+    for (int i = 0; i < children; ++i) {
+        QProcess* p = new QProcess(this);
+        p->start(QSL("sleep"), {QSL("60")});
+        processes << p;
+    }
+    for (QProcess* p : qAsConst(processes))
+        p->waitForStarted();
+
+    size_t found = 0;
+    QBENCHMARK {
+        found = scan ? ProcReaper::scanChildren(::getpid()).size() : ProcReaper::children(::getpid()).size();
+    }
+
+    for (QProcess* p : qAsConst(processes)) {
+        p->kill();
+        p->waitForFinished();
+        delete p;
+    }
+    QVERIFY(found >= static_cast<size_t>(children));
+}
+
+void SessionBench::powerSource_data()
+{
+    QTest::addColumn<QString>("charger");
+    QTest::addColumn<bool>("online");
+    QTest::addColumn<QString>("scope");
+    QTest::addColumn<QString>("status");
+    QTest::addColumn<bool>("onBattery");
+
+    QTest::newRow("mains online") << QSL("Mains") << true << QSL("System") << QSL("Charging") << false;
+    QTest::newRow("mains offline") << QSL("Mains") << false << QSL("System") << QSL("Discharging") << true;
+    QTest::newRow("no charger reported") << QString() << false << QSL("System") << QSL("Discharging") << true;
+    QTest::newRow("usb-c charger online") << QSL("USB_C") << true << QSL("System") << QSL("Discharging") << false;
+    QTest::newRow("usb pd charger online") << QSL("USB_PD") << true << QSL("System") << QSL("Discharging") << false;
+    QTest::newRow("wireless charger online") << QSL("Wireless") << true << QSL("System") << QSL("Discharging") << false;
+    QTest::newRow("peripheral battery only") << QString() << false << QSL("Device") << QSL("Discharging") << false;
+    QTest::newRow("battery full") << QString() << false << QSL("System") << QSL("Full") << false;
+}
+
+void SessionBench::powerSource()
+{
+    QFETCH(QString, charger);
+    QFETCH(bool, online);
+    QFETCH(QString, scope);
+    QFETCH(QString, status);
+    QFETCH(bool, onBattery);
+
+    QTemporaryDir root;
+    QVERIFY(root.isValid());
+    if (!charger.isEmpty())
+        QVERIFY(write_supply(root.path(), QSL("AC"), {{QSL("type"), charger}, {QSL("online"), online ? QSL("1") : QSL("0")}}));
+    QVERIFY(write_supply(root.path(), QSL("BAT0"), {{QSL("type"), QSL("Battery")}, {QSL("scope"), scope}, {QSL("status"), status}}));
+
+    PowerSourceWatcher watcher;
+    watcher.setSysfsRoot(root.path());
+    QCOMPARE(watcher.onBattery(), onBattery);
+}
+
+void SessionBench::powerSourceChange()
+{
+    QTemporaryDir root;
+    QVERIFY(root.isValid());
+    QVERIFY(write_supply(root.path(), QSL("AC"), {{QSL("type"), QSL("Mains")}, {QSL("online"), QSL("1")}}));
+    QVERIFY(write_supply(root.path(), QSL("BAT0"), {{QSL("type"), QSL("Battery")}, {QSL("status"), QSL("Charging")}}));
+
+    PowerSourceWatcher watcher;
+    watcher.setSysfsRoot(root.path());
+    QVERIFY(!watcher.onBattery());
+    QSignalSpy spy(&watcher, &PowerSourceWatcher::onBatteryChanged);
+
+    // unplugged: the charger goes offline, the battery starts discharging
+    QVERIFY(write_supply(root.path(), QSL("AC"), {{QSL("online"), QSL("0")}}));
+    QVERIFY(write_supply(root.path(), QSL("BAT0"), {{QSL("status"), QSL("Discharging")}}));
+    QVERIFY(spy.wait(POWER_CHANGE_TIMEOUT_MS));
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.first().first().toBool(), true);
+    QVERIFY(watcher.onBattery());
+
+    // a charger plugged in later is a new supply directory
+    QVERIFY(write_supply(root.path(), QSL("usb-c"), {{QSL("type"), QSL("USB_C")}, {QSL("online"), QSL("1")}}));
+    QVERIFY(spy.wait(POWER_CHANGE_TIMEOUT_MS));
+    QCOMPARE(spy.last().first().toBool(), false);
+    QVERIFY(!watcher.onBattery());
+}
+
+void SessionBench::loggerResidentMemory()
+{
+    // the ring lives in the logger instance, only used slots should count
+    const qint64 before = resident_memory(QCoreApplication::applicationPid());
+    AsyncLogger* logger = AsyncLogger::instance();
+    QVERIFY(logger->open(mHome.filePath(QSL("bench.log"))));
+    const qint64 opened = resident_memory(QCoreApplication::applicationPid());
+
+    for (int i = 0; i < 10000; ++i)
+        log_debug("benchmark record %d", i);
+    logger->close();
+    const qint64 used = resident_memory(QCoreApplication::applicationPid());
+
+    qInfo("logger RSS: +%lld kB after open, +%lld kB after 10000 records", opened - before, used - before);
+    QTest::setBenchmarkResult(used - before, QTest::BytesAllocated);
+}
+
+void SessionBench::metricsClient_data()
+{
+    QTest::addColumn<QByteArray>("request");
+    QTest::addColumn<bool>("http");
+
+    // socat and nc connect and read without sending anything
+    QTest::newRow("silent") << QByteArray() << false;
+    QTest::newRow("http") << QByteArray("GET /metrics HTTP/1.0\r\n\r\n") << true;
+}
+
+void SessionBench::metricsClient()
+{
+    QFETCH(QByteArray, request);
+    QFETCH(bool, http);
+
+    const QString run = mHome.filePath(QSL("metrics-run"));
+    QDir().mkpath(run);
+    QFile::setPermissions(run, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+    qputenv("XDG_RUNTIME_DIR", QFile::encodeName(run));
+
+    MetricsServer server;
+    QVERIFY(server.listen());
+
+    // a plain socket, the server must not rely on anything Qt on the other end
+    const QByteArray fileName = QFile::encodeName(server.path());
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    QVERIFY(fileName.size() < static_cast<int>(sizeof(addr.sun_path)));
+    memcpy(addr.sun_path, fileName.constData(), fileName.size());
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    QVERIFY(fd >= 0);
+    QCOMPARE(::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)), 0);
+    if (!request.isEmpty())
+        QCOMPARE(::write(fd, request.constData(), request.size()), static_cast<ssize_t>(request.size()));
+    ::fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    // the server answers from the event loop, which runs between the reads
+    QByteArray response;
+    QElapsedTimer timer;
+    timer.start();
+    bool closed = false;
+    while (!closed && timer.elapsed() < METRICS_CLIENT_TIMEOUT_MS) {
+        char buf[4096];
+        const ssize_t len = ::read(fd, buf, sizeof(buf));
+        if (len > 0)
+            response.append(buf, static_cast<int>(len));
+        else if (len == 0)
+            closed = true;
+        else if (errno == EAGAIN)
+            QTest::qWait(5);
+        else
+            break;
+    }
+    ::close(fd);
+
+    QVERIFY2(closed, "the server did not close the connection");
+    QCOMPARE(response.startsWith("HTTP/1.0 200 OK\r\n"), http);
+    QVERIFY(response.contains("graceful_session_spawns_total "));
+    QVERIFY(response.endsWith("# EOF\n"));
+    qInfo("%s: %d bytes after %lld ms", QTest::currentDataTag(), response.size(), timer.elapsed());
+}
+
+qint64 SessionBench::startSession(qint64 *rssKb)
+{
+    const QString binary = qEnvironmentVariable("GRACEFUL_SESSION_BIN", QSL(SESSION_BINARY));
+    if (qgetenv("DISPLAY").isEmpty() || !QFileInfo(binary).isExecutable())
+        return -1;
+
+    // a private home: the startup summary in its log tells when the startup is done
+    const QString run = mHome.filePath(QSL("run"));
+    QDir().mkpath(run);
+    QFile::setPermissions(run, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+    QDir().mkpath(mHome.filePath(QSL("config/graceful")));
+    QDir().mkpath(mHome.filePath(QSL("xdg")));
+    QFile config(mHome.filePath(QSL("config/graceful/session.conf")));
+    if (!config.open(QIODevice::WriteOnly))
+        return -1;
+    config.write("[Log]\nformat=text\n");
+    config.close();
+
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert(QSL("HOME"), mHome.path());
+    env.insert(QSL("XDG_CONFIG_HOME"), mHome.filePath(QSL("config")));
+    env.insert(QSL("XDG_DATA_HOME"), mHome.filePath(QSL("data")));
+    env.insert(QSL("XDG_RUNTIME_DIR"), run);
+    // no system autostart entries, they differ from machine to machine
+    env.insert(QSL("XDG_CONFIG_DIRS"), mHome.filePath(QSL("xdg")));
+
+    QFile log(mHome.filePath(QSL(".local/log/graceful-session.log")));
+    log.remove();
+
+    QProcess session;
+    session.setProcessEnvironment(env);
+    QElapsedTimer timer;
+    timer.start();
+    session.start(binary, QStringList());
+    if (!session.waitForStarted())
+        return -1;
+
+    // StartupTimings::dump() closes the startup with the phase durations
+    QByteArrayList phases;
+    qint64 startup = -1;
+    while (startup < 0 && timer.elapsed() < SESSION_STARTUP_TIMEOUT_MS && session.state() == QProcess::Running) {
+        QTest::qWait(5);
+        if (!log.isOpen() && !log.open(QIODevice::ReadOnly))
+            continue;
+        while (log.canReadLine()) {
+            const QByteArray line = log.readLine().trimmed();
+            if (line.contains("startup phase "))
+                phases << line;
+            else if (line.contains(STARTUP_DONE_LINE))
+                startup = timer.elapsed();
+        }
+    }
+
+    if (startup >= 0) {
+        for (const QByteArray& line : qAsConst(phases))
+            qInfo("%s", line.constData());
+
+        QTest::qWait(SESSION_SETTLE_MS);
+        if (rssKb)
+            *rssKb = resident_memory(session.processId());
+    }
+
+    ::kill(static_cast<pid_t>(session.processId()), SIGTERM);
+    if (!session.waitForFinished(10000))
+        session.kill();
+    return startup;
+}
+
+void SessionBench::startupTime()
+{
+    qint64 rss = -1;
+    const qint64 ms = startSession(&rss);
+    if (ms < 0)
+        QSKIP("graceful-session did not start, see the class documentation");
+
+    qInfo("startup: %lld ms", ms);
+    QTest::setBenchmarkResult(ms, QTest::WalltimeMilliseconds);
+}
+
+void SessionBench::startupResidentMemory()
+{
+    qint64 rss = -1;
+    if (startSession(&rss) < 0 || rss < 0)
+        QSKIP("graceful-session did not start, see the class documentation");
+
+    qInfo("resident memory after startup: %lld kB", rss);
+    QTest::setBenchmarkResult(rss * 1024, QTest::BytesAllocated);
+}
+
+QTEST_GUILESS_MAIN(SessionBench)
@@ -0,0 +1,54 @@
+#ifndef SESSIONBENCH_H
+#define SESSIONBENCH_H
+
+#include <QObject>
+#include <QTemporaryDir>
+
+/**
+ * @brief Benchmarks of the session core, and checks of the power source
+ * watcher against a fake sysfs tree.
+ *
+ * Runs without an X server except for the startup benchmarks, which start
+ * the real graceful-session and need a display with a window manager and
+ * a private session bus, e.g.:
+ *   xvfb-run dbus-run-session graceful-session-bench
+ */
+class SessionBench : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void programLookup_data();
+    void programLookup();
+    void windowManagerList();
+    void setEnvironment_data();
+    void setEnvironment();
+    void autostartList_data();
+    void autostartList();
+    void expandExec_data();
+    void expandExec();
+    void reaperChildren_data();
+    void reaperChildren();
+    void powerSource_data();
+    void powerSource();
+    void powerSourceChange();
+
+    void loggerResidentMemory();
+    void metricsClient_data();
+    void metricsClient();
+    void startupTime();
+    void startupResidentMemory();
+
+private:
+    // n files in $XDG_CONFIG_HOME/autostart, the others are removed
+    void writeAutostart(int n);
+    // starts graceful-session in mHome, -1 if it did not come up
+    qint64 startSession(qint64 *rssKb);
+
+private:
+    QTemporaryDir   mHome;
+};
+
+#endif // SESSIONBENCH_H
@@ -0,0 +1,59 @@
+TEMPLATE    = app
+TARGET      = graceful-session-bench
+
+QT          += core gui xml dbus x11extras testlib network
+
+CONFIG      += c++11 console link_pkgconfig no_keywords
+CONFIG      -= app_bundle
+PKGCONFIG   += graceful Qt5Xdg
+LIBS        += -lprocps
+PKGCONFIG   += xcb udev
+include($$PWD/../common/common.pri)
+
+INCLUDEPATH += $$PWD/../session
+
+# the session binary of this build tree, GRACEFUL_SESSION_BIN overrides it
+DEFINES     += SESSION_BINARY='\\"$$OUT_PWD/../session/graceful-session\\"'
+# the shipped window manager list, getWindowManagerList() reads a copy
+DEFINES     += WINDOWMANAGERS_CONF='\\"$$PWD/../session/data/windowmanagers.conf\\"'
+
+SOURCES     += \
+    $$PWD/session-bench.cpp                             \
+    $$PWD/../session/async-logger.cpp                   \
+    $$PWD/../session/session-environment.cpp            \
+    $$PWD/../session/window-manager.cpp                 \
+    $$PWD/../session/proc-reaper.cpp                    \
+    $$PWD/../session/metrics.cpp                        \
+    $$PWD/../session/metrics-server.cpp                 \
+    $$PWD/../session/startup-timings.cpp                \
+    $$PWD/../session/session-settings.cpp               \
+    $$PWD/../session/startup-history.cpp                \
+    $$PWD/../session/error-notifier.cpp                 \
+    $$PWD/../session/module-output.cpp                  \
+    $$PWD/../session/process-tree.cpp                   \
+    $$PWD/../session/memory-monitor.cpp                 \
+    $$PWD/../session/x11-utils.cpp                      \
+    $$PWD/../session/graceful-modman.cpp                \
+    $$PWD/../session/udev-monitor.cpp                   \
+    $$PWD/../session/power-source-watcher.cpp           \
+
+
+HEADERS     += \
+    $$PWD/session-bench.h                               \
+    $$PWD/../session/async-logger.h                     \
+    $$PWD/../session/session-environment.h              \
+    $$PWD/../session/window-manager.h                   \
+    $$PWD/../session/proc-reaper.h                      \
+    $$PWD/../session/metrics.h                          \
+    $$PWD/../session/metrics-server.h                   \
+    $$PWD/../session/startup-timings.h                  \
+    $$PWD/../session/session-settings.h                 \
+    $$PWD/../session/startup-history.h                  \
+    $$PWD/../session/error-notifier.h                   \
+    $$PWD/../session/module-output.h                    \
+    $$PWD/../session/process-tree.h                     \
+    $$PWD/../session/memory-monitor.h                   \
+    $$PWD/../session/x11-utils.h                        \
+    $$PWD/../session/graceful-modman.h                  \
+    $$PWD/../session/udev-monitor.h                     \
+    $$PWD/../session/power-source-watcher.h             \
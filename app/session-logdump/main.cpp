@@ -0,0 +1,59 @@
+#include "log-record-format.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+static const char* const LEVEL_NAMES[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
+
+static int dump(FILE *in, FILE *out)
+{
+    char magic[GRACEFUL_LOG_MAGIC_SIZE];
+    if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, GRACEFUL_LOG_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "not a binary graceful-session log\n");
+        return 1;
+    }
+
+    graceful_log_record record;
+    std::vector<char> file, message;
+    while (fread(&record, sizeof(record), 1, in) == 1) {
+        file.resize(record.fileLength);
+        message.resize(record.messageLength);
+        if (fread(file.data(), 1, file.size(), in) != file.size()
+            || fread(message.data(), 1, message.size(), in) != message.size()) {
+            fprintf(stderr, "truncated record\n");
+            return 1;
+        }
+
+        char stamp[32];
+        const time_t secs = record.timestamp / 1000;
+        struct tm tm;
+        localtime_r(&secs, &tm);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+        fprintf(out, "%s.%03d %-5s %.*s:%u: %.*s\n", stamp, int(record.timestamp % 1000),
+                LEVEL_NAMES[record.level <= 5 ? record.level : 5],
+                int(file.size()), file.data(), record.line, int(message.size()), message.data());
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2 || (argc == 2 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")))) {
+        fprintf(stderr, "usage: %s [binary log file]\n", argv[0]);
+        return 2;
+    }
+
+    FILE* in = argc == 2 ? fopen(argv[1], "rb") : stdin;
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    const int ret = dump(in, stdout);
+    if (in != stdin)
+        fclose(in);
+    return ret;
+}
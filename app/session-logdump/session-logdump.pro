@@ -0,0 +1,21 @@
+TEMPLATE    = app
+TARGET      = graceful-session-logdump
+
+CONFIG      += console c++11
+CONFIG      -= qt app_bundle
+
+INCLUDEPATH += $$PWD/../session
+
+SOURCES     += \
+    $$PWD/main.cpp                                      \
+
+
+HEADERS     += \
+    $$PWD/../session/log-record-format.h                \
+
+
+GRACEFUL_SESSION_LOGDUMP.files = $$OUT_PWD/graceful-session-logdump
+GRACEFUL_SESSION_LOGDUMP.path = /usr/bin/
+
+
+INSTALLS += GRACEFUL_SESSION_LOGDUMP
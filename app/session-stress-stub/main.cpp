@@ -0,0 +1,92 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <signal.h>
+#include <unistd.h>
+
+// how the module misbehaves, from the command line
+struct Options {
+    long    crashAfterMs = -1;
+    bool    hang = false;
+    long    spam = 0;       // lines per second
+    long    children = 0;
+};
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [--crash-after ms] [--hang] [--spam lines/s] [--children n]\n", name);
+}
+
+static bool parse(int argc, char *argv[], Options &options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--crash-after") && hasValue)
+            options.crashAfterMs = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--hang"))
+            options.hang = true;
+        else if (!strcmp(argv[i], "--spam") && hasValue)
+            options.spam = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--children") && hasValue)
+            options.children = atol(argv[++i]);
+        else
+            return false;
+    }
+    return true;
+}
+
+static void sleep_ms(long ms)
+{
+    struct timespec ts{ms / 1000, (ms % 1000) * 1000000};
+    while (nanosleep(&ts, &ts) != 0)
+        ;
+}
+
+/**
+ * @brief A module for the stress harness: it crashes, ignores SIGTERM,
+ * floods its output or leaves children behind, as asked.
+ */
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parse(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // a hanging module only goes away with SIGKILL at the end of the logout
+    if (options.hang)
+        signal(SIGTERM, SIG_IGN);
+
+    // the children outlive the module, the session has to find them
+    for (long i = 0; i < options.children; ++i) {
+        if (fork() == 0) {
+            for (;;)
+                pause();
+        }
+    }
+
+    if (options.crashAfterMs >= 0 && !options.spam) {
+        sleep_ms(options.crashAfterMs);
+        abort();
+    }
+
+    if (options.spam > 0) {
+        const long intervalMs = options.spam >= 1000 ? 1 : 1000 / options.spam;
+        const long perInterval = options.spam >= 1000 ? options.spam / 1000 : 1;
+        long elapsedMs = 0;
+        for (unsigned long line = 0;; ++line) {
+            for (long i = 0; i < perInterval; ++i)
+                printf("stub %d line %lu: the quick brown fox jumps over the lazy dog\n", getpid(), line);
+            fflush(stdout);
+            sleep_ms(intervalMs);
+            elapsedMs += intervalMs;
+            if (options.crashAfterMs >= 0 && elapsedMs >= options.crashAfterMs)
+                abort();
+        }
+    }
+
+    for (;;)
+        pause();
+}
@@ -0,0 +1,8 @@
+TEMPLATE    = app
+TARGET      = graceful-session-stress-stub
+
+CONFIG      += console c++11
+CONFIG      -= qt app_bundle
+
+SOURCES     += \
+    $$PWD/main.cpp                                      \
@@ -0,0 +1,228 @@
+#include "session-stress.h"
+
+#include <graceful/globals.h>
+
+#include <QtTest>
+#include <QDir>
+#include <QFile>
+#include <QLocalSocket>
+#include <QProcess>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QStandardPaths>
+
+#include <signal.h>
+
+#define SESSION_STARTUP_TIMEOUT_MS  (60 * 1000)
+#define SERVER_STARTUP_TIMEOUT_MS   (10 * 1000)
+// long enough for crash restarts and several process scans
+#define STRESS_SETTLE_MS            (10 * 1000)
+#define LOGOUT_WAIT_MS              (30 * 1000)
+#define SPAM_LINES_PER_SECOND       1000
+#define CRASH_AFTER_MS              500
+
+/**
+ * @brief VmRSS of pid in kB, -1 if unknown
+ */
+static qint64 resident_memory(qint64 pid)
+{
+    QFile status(QSL("/proc/%1/status").arg(pid));
+    if (!status.open(QIODevice::ReadOnly))
+        return -1;
+
+    while (!status.atEnd()) {
+        const QByteArray line = status.readLine();
+        if (line.startsWith("VmRSS:"))
+            return line.mid(6).trimmed().split(' ').first().toLongLong();
+    }
+    return -1;
+}
+
+static int open_files(qint64 pid)
+{
+    return QDir(QSL("/proc/%1/fd").arg(pid)).entryList(QDir::NoDotAndDotDot | QDir::AllEntries | QDir::System).size();
+}
+
+/**
+ * @brief value of an unlabelled sample in the OpenMetrics text, 0 if missing
+ */
+static double metric_value(const QByteArray &metrics, const QByteArray &name)
+{
+    for (const QByteArray &line : metrics.split('\n')) {
+        if (line.startsWith(name + ' '))
+            return line.mid(name.size() + 1).toDouble();
+    }
+    return 0;
+}
+
+static QByteArray read_metrics(const QString &socket)
+{
+    QLocalSocket metrics;
+    metrics.connectToServer(socket);
+    if (!metrics.waitForConnected(1000))
+        return QByteArray();
+
+    metrics.write("GET /metrics HTTP/1.0\r\n\r\n");
+    while (metrics.waitForReadyRead(1000))
+        ;
+    return metrics.readAll();
+}
+
+/**
+ * @brief one desktop file per stub; each runs through its own link, the
+ * session names modules after the program of their Exec line
+ */
+static bool write_modules(const QDir &home, const QStringList &args)
+{
+    const QString stub = qEnvironmentVariable("GRACEFUL_STRESS_STUB_BIN", QSL(STUB_BINARY));
+    for (int i = 0; i < args.size(); ++i) {
+        const QString link = home.filePath(QSL("bin/stub-%1").arg(i));
+        if (!QFile::link(stub, link))
+            return false;
+
+        QFile file(home.filePath(QSL("config/autostart/stub-%1.desktop").arg(i)));
+        if (!file.open(QIODevice::WriteOnly))
+            return false;
+        file.write(QSL("[Desktop Entry]\n"
+                       "Type=Application\n"
+                       "Name=Stub %1\n"
+                       "Exec=%2 %3\n"
+                       "X-Graceful-Module=true\n").arg(i).arg(link, args.at(i)).toUtf8());
+    }
+    return true;
+}
+
+QByteArray SessionStress::startServer(QProcess &server, const QString &program, const QStringList &args)
+{
+    if (QStandardPaths::findExecutable(program).isEmpty())
+        return QByteArray();
+
+    server.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    server.start(program, args);
+    QElapsedTimer timer;
+    timer.start();
+    while (!server.canReadLine() && timer.elapsed() < SERVER_STARTUP_TIMEOUT_MS && server.state() != QProcess::NotRunning)
+        server.waitForReadyRead(100);
+    return server.canReadLine() ? server.readLine().trimmed() : QByteArray();
+}
+
+void SessionStress::init()
+{
+    // -displayfd picks a free display and prints its number
+    const QByteArray display = startServer(mXvfb, QSL("Xvfb"), {QSL("-displayfd"), QSL("1"), QSL("-nolisten"), QSL("tcp")});
+    mDisplay = display.isEmpty() ? QByteArray() : ':' + display;
+    mBusAddress = startServer(mBus, QSL("dbus-daemon"), {QSL("--session"), QSL("--nofork"), QSL("--print-address=1")});
+}
+
+void SessionStress::cleanup()
+{
+    for (QProcess *server : {&mBus, &mXvfb}) {
+        server->terminate();
+        if (!server->waitForFinished(5000))
+            server->kill();
+    }
+}
+
+void SessionStress::modules_data()
+{
+    QTest::addColumn<int>("quiet");
+    QTest::addColumn<int>("crashing");
+    QTest::addColumn<int>("hanging");
+    QTest::addColumn<int>("spamming");
+
+    QTest::newRow("baseline") << 0 << 0 << 0 << 0;
+    QTest::newRow("50 quiet") << 50 << 0 << 0 << 0;
+    QTest::newRow("200 quiet") << 200 << 0 << 0 << 0;
+    QTest::newRow("50 misbehaving") << 20 << 10 << 10 << 10;
+    QTest::newRow("200 misbehaving") << 80 << 40 << 40 << 40;
+}
+
+void SessionStress::modules()
+{
+    QFETCH(int, quiet);
+    QFETCH(int, crashing);
+    QFETCH(int, hanging);
+    QFETCH(int, spamming);
+
+    const QString binary = qEnvironmentVariable("GRACEFUL_SESSION_BIN", QSL(SESSION_BINARY));
+    if (mDisplay.isEmpty() || mBusAddress.isEmpty() || !QFileInfo(binary).isExecutable())
+        QSKIP("graceful-session can not run, see the class documentation");
+
+    QTemporaryDir tmp;
+    QVERIFY(tmp.isValid());
+    const QDir home(tmp.path());
+    for (const char *dir : {"run", "config/graceful", "config/autostart", "xdg", "bin"})
+        QVERIFY(home.mkpath(QL1S(dir)));
+    QFile::setPermissions(home.filePath(QSL("run")), QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+
+    QFile config(home.filePath(QSL("config/graceful/session.conf")));
+    QVERIFY(config.open(QIODevice::WriteOnly));
+    config.write("[General]\nmetrics=true\nrestore_session=false\n");
+    config.close();
+
+    QStringList args;
+    for (int i = 0; i < quiet; ++i)
+        args << QSL("--children 1");
+    for (int i = 0; i < crashing; ++i)
+        args << QSL("--crash-after %1").arg(CRASH_AFTER_MS);
+    for (int i = 0; i < hanging; ++i)
+        args << QSL("--hang");
+    for (int i = 0; i < spamming; ++i)
+        args << QSL("--spam %1").arg(SPAM_LINES_PER_SECOND);
+    QVERIFY(write_modules(home, args));
+
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert(QSL("DISPLAY"), QString::fromLatin1(mDisplay));
+    env.insert(QSL("DBUS_SESSION_BUS_ADDRESS"), QString::fromLatin1(mBusAddress));
+    env.insert(QSL("HOME"), home.path());
+    env.insert(QSL("XDG_CONFIG_HOME"), home.filePath(QSL("config")));
+    env.insert(QSL("XDG_DATA_HOME"), home.filePath(QSL("data")));
+    env.insert(QSL("XDG_RUNTIME_DIR"), home.filePath(QSL("run")));
+    // only the stubs, no system autostart entries
+    env.insert(QSL("XDG_CONFIG_DIRS"), home.filePath(QSL("xdg")));
+
+    const QString socket = home.filePath(QSL("run/graceful-session/metrics.sock"));
+    QProcess session;
+    session.setProcessEnvironment(env);
+    session.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    session.setStandardOutputFile(QProcess::nullDevice());
+    QElapsedTimer timer;
+    timer.start();
+    session.start(binary, QStringList());
+    QVERIFY(session.waitForStarted());
+
+    while (!QFile::exists(socket) && timer.elapsed() < SESSION_STARTUP_TIMEOUT_MS && session.state() == QProcess::Running)
+        QTest::qWait(5);
+    QVERIFY2(QFile::exists(socket), "graceful-session did not come up");
+    QTest::qWait(STRESS_SETTLE_MS);
+
+    const qint64 pid = session.processId();
+    const qint64 rss = resident_memory(pid);
+    const int fds = open_files(pid);
+    const QByteArray metrics = read_metrics(socket);
+
+    const double lagCount = metric_value(metrics, "graceful_session_event_loop_lag_seconds_count");
+    const double scanCount = metric_value(metrics, "graceful_session_process_scan_seconds_count");
+    const double lagMs = lagCount > 0 ? metric_value(metrics, "graceful_session_event_loop_lag_seconds_sum") * 1000 / lagCount : 0;
+    const double scanUs = scanCount > 0 ? metric_value(metrics, "graceful_session_process_scan_seconds_sum") * 1e6 / scanCount : 0;
+
+    timer.restart();
+    ::kill(static_cast<pid_t>(pid), SIGTERM);
+    if (!session.waitForFinished(LOGOUT_WAIT_MS))
+        session.kill();
+    const qint64 logoutMs = timer.elapsed();
+
+    const int modules = args.size();
+    if (modules == 0) {
+        mBaselineRssKb = rss;
+        mBaselineFds = fds;
+    }
+    qInfo("%d modules: event loop lag %.2f ms, process scan %.0f us, RSS %lld kB, %d fds, logout %lld ms, %.0f crashes",
+          modules, lagMs, scanUs, rss, fds, logoutMs, metric_value(metrics, "graceful_session_crashes_total"));
+    if (modules > 0 && mBaselineRssKb >= 0)
+        qInfo("per module: %.1f kB RSS, %.2f fds", double(rss - mBaselineRssKb) / modules, double(fds - mBaselineFds) / modules);
+
+    QTest::setBenchmarkResult(logoutMs, QTest::WalltimeMilliseconds);
+}
+
+QTEST_GUILESS_MAIN(SessionStress)
@@ -0,0 +1,43 @@
+#ifndef SESSIONSTRESS_H
+#define SESSIONSTRESS_H
+
+#include <QObject>
+#include <QProcess>
+
+/**
+ * @brief Runs the real graceful-session with many stub modules.
+ *
+ * Every row starts a session in a private home whose autostart holds only
+ * stub modules: quiet ones with a child each, crashing, hanging and
+ * spamming ones. The event loop lag, the process scan time, the resident
+ * memory and open files per module and the logout time are reported.
+ * Every row gets its own Xvfb and session bus, so Xvfb and dbus-daemon
+ * must be installed; the session starts its window manager on it.
+ */
+class SessionStress : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void modules_data();
+    void modules();
+
+private:
+    // the first line the server writes to stdout, empty if it did not start
+    static QByteArray startServer(QProcess &server, const QString &program, const QStringList &args);
+
+private:
+    QProcess    mXvfb;
+    QProcess    mBus;
+    QByteArray  mDisplay;
+    QByteArray  mBusAddress;
+
+    // the first row runs without modules, the others are compared with it
+    qint64  mBaselineRssKb = -1;
+    int     mBaselineFds = -1;
+};
+
+#endif // SESSIONSTRESS_H
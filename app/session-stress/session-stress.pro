@@ -0,0 +1,20 @@
+TEMPLATE    = app
+TARGET      = graceful-session-stress
+
+QT          += core testlib network
+
+CONFIG      += c++11 console link_pkgconfig no_keywords
+CONFIG      -= app_bundle
+PKGCONFIG   += graceful
+include($$PWD/../common/common.pri)
+
+# the binaries of this build tree, GRACEFUL_SESSION_BIN overrides the session
+DEFINES     += SESSION_BINARY='\\"$$OUT_PWD/../session/graceful-session\\"'
+DEFINES     += STUB_BINARY='\\"$$OUT_PWD/../session-stress-stub/graceful-session-stress-stub\\"'
+
+SOURCES     += \
+    $$PWD/session-stress.cpp                            \
+
+
+HEADERS     += \
+    $$PWD/session-stress.h                              \
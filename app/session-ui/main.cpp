@@ -0,0 +1,59 @@
+#include <QApplication>
+#include <QMessageBox>
+#include <QCommandLineParser>
+#include <cstdio>
+
+#include <graceful/globals.h>
+#include "wm-select-dialog.h"
+#include "window-manager.h"
+
+/**
+ * graceful-session-ui holds the dialogs of graceful-session, which itself
+ * does not link QtWidgets. It is started on demand and exits when the
+ * dialog is closed; results go to stdout.
+ */
+int main (int argc, char* argv[])
+{
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Graceful Session dialogs"));
+    app.setApplicationVersion(QString("version:(%1),build by QT(%2)").arg(VERSION).arg(QStringLiteral(QT_VERSION_STR)));
+    const QCommandLineOption select_wm_opt{{("select-wm")}, QApplication::tr("Ask for the window manager and print its command.")};
+    const QCommandLineOption critical_opt{{("critical")}, QApplication::tr("Show an error message.")};
+    const QCommandLineOption warning_opt{{("warning")}, QApplication::tr("Show a warning message.")};
+    parser.addVersionOption();
+    parser.addHelpOption();
+    parser.addOptions({select_wm_opt, critical_opt, warning_opt});
+    parser.addPositionalArgument(QSL("title"), QApplication::tr("Message title."));
+    parser.addPositionalArgument(QSL("text"), QApplication::tr("Message text."));
+    parser.process(app);
+
+    if (parser.isSet(select_wm_opt)) {
+        WindowManagerList availableWM = getWindowManagerList(true);
+        QString wm;
+        if (availableWM.count() == 1) {
+            wm = availableWM.at(0).command;
+        } else {
+            WMSelectDialog dlg(availableWM);
+            dlg.exec();
+            wm = dlg.windowManager();
+        }
+        if (wm.isEmpty())
+            return 1;
+        printf("%s\n", wm.toLocal8Bit().constData());
+        return 0;
+    }
+
+    if (parser.isSet(critical_opt) || parser.isSet(warning_opt)) {
+        const QStringList args = parser.positionalArguments();
+        if (args.count() != 2)
+            parser.showHelp(1);
+
+        QMessageBox box(parser.isSet(critical_opt) ? QMessageBox::Critical : QMessageBox::Warning,
+                        args.at(0), args.at(1), QMessageBox::Ok);
+        return box.exec() == QMessageBox::Ok ? 0 : 1;
+    }
+
+    parser.showHelp(1);
+}
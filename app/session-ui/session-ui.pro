@@ -0,0 +1,31 @@
+TEMPLATE    = app
+TARGET      = graceful-session-ui
+
+QT          += core gui widgets
+
+CONFIG      += c++11 link_pkgconfig no_keywords
+PKGCONFIG   += graceful
+include($$PWD/../common/common.pri)
+
+INCLUDEPATH += $$PWD/../session
+
+SOURCES     += \
+    $$PWD/main.cpp                                      \
+    $$PWD/wm-select-dialog.cpp                          \
+    $$PWD/../session/window-manager.cpp                 \
+
+
+HEADERS     += \
+    $$PWD/wm-select-dialog.h                            \
+    $$PWD/../session/window-manager.h                   \
+
+
+FORMS       += \
+    $$PWD/wm-select-dialog.ui
+
+
+GRACEFUL_SESSION_UI.files = $$OUT_PWD/graceful-session-ui
+GRACEFUL_SESSION_UI.path = /usr/bin/
+
+
+INSTALLS += GRACEFUL_SESSION_UI
@@ -0,0 +1,315 @@
+#include "async-logger.h"
+
+#include "log-record-format.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+
+#include <ctime>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+// only without an eventfd the writer has to poll
+#define LOG_IDLE_WAIT_US        20000
+#define LOG_DEFAULT_MAX_SIZE    (4 * 1024 * 1024)
+#define LOG_DEFAULT_MAX_FILES   3
+
+static const char* const LEVEL_NAMES[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
+
+std::atomic<AsyncLogger*> AsyncLogger::sSink{nullptr};
+
+AsyncLogger* AsyncLogger::instance()
+{
+    static AsyncLogger logger;
+    return &logger;
+}
+
+AsyncLogger::AsyncLogger() :
+    mEnqueuePos(0),
+    mDequeuePos(0),
+    mLevel(LOG_TRACE),
+    mFormat(Text),
+    mMaxSize(LOG_DEFAULT_MAX_SIZE),
+    mMaxFiles(LOG_DEFAULT_MAX_FILES),
+    mReopen(false),
+    mRunning(false),
+    mDropped(0),
+    mWakeFd(eventfd(0, EFD_CLOEXEC)),
+    mSleeping(false),
+    mFile(nullptr),
+    mFileFormat(Text)
+{
+    // the ring is not touched here: a slot stores its sequence minus its
+    // index, so the zero pages are already the initial state and only
+    // become resident once records pass through them
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    close();
+    if (mWakeFd >= 0)
+        ::close(mWakeFd);
+}
+
+bool AsyncLogger::open(const QString &path)
+{
+    mPath = QFile::encodeName(path);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    if (!openFile())
+        return false;
+
+    mRunning = true;
+    mWriter = std::thread(&AsyncLogger::run, this);
+    // registered once, close() only unhooks the sink
+    static bool registered = false;
+    if (!registered) {
+        log_add_callback(&AsyncLogger::logCallback, nullptr, LOG_TRACE);
+        registered = true;
+    }
+    sSink = this;
+    return true;
+}
+
+bool AsyncLogger::resume()
+{
+    if (mRunning || mPath.isEmpty() || !openFile())
+        return false;
+
+    mRunning = true;
+    mWriter = std::thread(&AsyncLogger::run, this);
+    sSink = this;
+    return true;
+}
+
+void AsyncLogger::close()
+{
+    if (!mRunning.exchange(false))
+        return;
+
+    // unhooked first, records arriving from now on would never be written
+    sSink = nullptr;
+
+    // the writer drains the ring before it returns
+    const uint64_t one = 1;
+    if (mWakeFd >= 0 && ::write(mWakeFd, &one, sizeof(one)) < 0)
+        perror("AsyncLogger: wake up");
+    mWriter.join();
+    if (mFile) {
+        fclose(mFile);
+        mFile = nullptr;
+    }
+}
+
+void AsyncLogger::setLevel(int level)
+{
+    mLevel = qBound(int(LOG_TRACE), level, int(LOG_FATAL));
+}
+
+int AsyncLogger::level() const
+{
+    return mLevel;
+}
+
+void AsyncLogger::setFormat(Format format)
+{
+    // a file never mixes both formats, the writer rotates first
+    if (mFormat.exchange(format) != format)
+        mReopen = true;
+}
+
+void AsyncLogger::setRotation(qint64 maxSize, int maxFiles)
+{
+    mMaxSize = maxSize;
+    mMaxFiles = maxFiles;
+}
+
+quint64 AsyncLogger::droppedRecords() const
+{
+    return mDropped;
+}
+
+void AsyncLogger::logCallback(log_Event *ev)
+{
+    AsyncLogger* self = sSink.load(std::memory_order_acquire);
+    if (!self || ev->level < self->mLevel.load(std::memory_order_relaxed))
+        return;
+    self->push(ev->level, ev->file, ev->line, ev->fmt, ev->ap);
+}
+
+void AsyncLogger::push(int level, const char *file, int line, const char *fmt, va_list ap)
+{
+    // bounded MPMC queue as described by Dmitry Vyukov, used with a single consumer
+    Record* record = nullptr;
+    quint64 index = 0;
+    quint64 pos = mEnqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        index = pos & (LOG_RING_SIZE - 1);
+        record = &mRing[index];
+        const quint64 seq = record->sequence.load(std::memory_order_acquire) + index;
+        const qint64 diff = qint64(seq) - qint64(pos);
+        if (diff == 0) {
+            if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = mEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    record->timestamp = qint64(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    record->file = file;
+    record->line = line;
+    record->level = level;
+
+    va_list copy;
+    va_copy(copy, ap);
+    const int len = vsnprintf(record->message, sizeof(record->message), fmt, copy);
+    va_end(copy);
+    record->length = qBound(0, len, int(sizeof(record->message)) - 1);
+
+    record->sequence.store(pos + 1 - index, std::memory_order_release);
+    wake();
+}
+
+void AsyncLogger::wake()
+{
+    // pairs with the fence in run(): either the writer sees the record or
+    // we see it sleeping, a busy writer costs no syscall
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mSleeping.load(std::memory_order_relaxed) && mWakeFd >= 0) {
+        const uint64_t one = 1;
+        if (::write(mWakeFd, &one, sizeof(one)) < 0)
+            return;
+    }
+}
+
+bool AsyncLogger::pop(Record &out)
+{
+    const quint64 index = mDequeuePos & (LOG_RING_SIZE - 1);
+    Record* record = &mRing[index];
+    if (record->sequence.load(std::memory_order_acquire) + index != mDequeuePos + 1)
+        return false;
+
+    out.timestamp = record->timestamp;
+    out.file = record->file;
+    out.line = record->line;
+    out.level = record->level;
+    out.length = record->length;
+    memcpy(out.message, record->message, record->length);
+
+    record->sequence.store(mDequeuePos + LOG_RING_SIZE - index, std::memory_order_release);
+    ++mDequeuePos;
+    return true;
+}
+
+void AsyncLogger::run()
+{
+    Record* record = new Record;
+    while (true) {
+        const bool running = mRunning.load();
+        bool wrote = false;
+        while (pop(*record)) {
+            if (mReopen.exchange(false))
+                rotate();
+            write(*record);
+            wrote = true;
+        }
+
+        if (wrote && mFile) {
+            fflush(mFile);
+            if (ftell(mFile) > mMaxSize.load())
+                rotate();
+        }
+
+        if (!running)
+            break;
+        if (wrote)
+            continue;
+        if (mWakeFd < 0) {
+            usleep(LOG_IDLE_WAIT_US);
+            continue;
+        }
+
+        mSleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const quint64 index = mDequeuePos & (LOG_RING_SIZE - 1);
+        if (mRing[index].sequence.load(std::memory_order_acquire) + index != mDequeuePos + 1 && mRunning.load()) {
+            uint64_t count;
+            if (::read(mWakeFd, &count, sizeof(count)) < 0 && errno != EINTR)
+                perror("AsyncLogger: wait");
+        }
+        mSleeping.store(false, std::memory_order_relaxed);
+    }
+    delete record;
+}
+
+void AsyncLogger::write(const Record &record)
+{
+    if (!mFile)
+        return;
+
+    const int level = qBound(0, record.level, 5);
+    const char* file = record.file ? record.file : "";
+
+    if (mFileFormat == Binary) {
+        graceful_log_record header;
+        header.timestamp = record.timestamp;
+        header.line = record.line;
+        header.fileLength = strlen(file);
+        header.messageLength = record.length;
+        header.level = level;
+        fwrite(&header, sizeof(header), 1, mFile);
+        fwrite(file, 1, header.fileLength, mFile);
+        fwrite(record.message, 1, record.length, mFile);
+        return;
+    }
+
+    char time[32];
+    const time_t secs = record.timestamp / 1000;
+    struct tm tm;
+    localtime_r(&secs, &tm);
+    strftime(time, sizeof(time), "%Y-%m-%d %H:%M:%S", &tm);
+    fprintf(mFile, "%s.%03d %-5s %s:%d: %.*s\n", time, int(record.timestamp % 1000), LEVEL_NAMES[level],
+            file, record.line, record.length, record.message);
+}
+
+bool AsyncLogger::openFile()
+{
+    mFile = fopen(mPath.constData(), "a");
+    if (!mFile)
+        return false;
+    fseek(mFile, 0, SEEK_END);
+
+    mFileFormat = mFormat.load();
+    if (mFileFormat == Binary && ftell(mFile) == 0)
+        fwrite(GRACEFUL_LOG_MAGIC, 1, GRACEFUL_LOG_MAGIC_SIZE, mFile);
+    return true;
+}
+
+void AsyncLogger::rotate()
+{
+    if (mFile) {
+        fclose(mFile);
+        mFile = nullptr;
+    }
+
+    // graceful-session.log -> .1 -> .2 ... the oldest one is dropped
+    const int maxFiles = mMaxFiles.load();
+    for (int i = maxFiles - 1; i >= 1; --i) {
+        const QByteArray from = i == 1 ? mPath : mPath + '.' + QByteArray::number(i - 1);
+        const QByteArray to = mPath + '.' + QByteArray::number(i);
+        ::rename(from.constData(), to.constData());
+    }
+    if (maxFiles <= 1)
+        ::unlink(mPath.constData());
+
+    openFile();
+}
@@ -0,0 +1,95 @@
+#ifndef ASYNCLOGGER_H
+#define ASYNCLOGGER_H
+
+#include <QString>
+#include <QByteArray>
+#include <graceful/log.h>
+#include <atomic>
+#include <thread>
+#include <cstdio>
+#include <cstdarg>
+
+#define LOG_RING_SIZE           256         // power of two
+#define LOG_MESSAGE_SIZE        480
+
+/**
+ * @brief Log sink which keeps file I/O off the calling threads.
+ *
+ * log_* calls format their message into a lock-free ring buffer (records
+ * are dropped and counted when it is full); a background thread writes
+ * them either as text or in the binary format of log-record-format.h and
+ * rotates the file once it exceeds the configured size.
+ */
+class AsyncLogger
+{
+public:
+    enum Format {
+        Text,
+        Binary
+    };
+
+    static AsyncLogger* instance();
+
+    bool open(const QString &path);
+    void close();
+    // reopens the file after close(), e.g. when an exec failed
+    bool resume();
+
+    void setLevel(int level);
+    int level() const;
+
+    void setFormat(Format format);
+    void setRotation(qint64 maxSize, int maxFiles);
+
+    quint64 droppedRecords() const;
+
+private:
+    struct Record {
+        std::atomic<quint64>    sequence;
+        qint64                  timestamp;
+        const char*             file;
+        int                     line;
+        int                     level;
+        int                     length;
+        char                    message[LOG_MESSAGE_SIZE];
+    };
+
+    AsyncLogger();
+    ~AsyncLogger();
+
+    // the logger log_* delivers to; null once closed, the callback of
+    // libgraceful can not be removed and outlives the instance
+    static std::atomic<AsyncLogger*> sSink;
+    static void logCallback(log_Event *ev);
+    void push(int level, const char *file, int line, const char *fmt, va_list ap);
+    void wake();
+
+    void run();
+    bool pop(Record &out);
+    void write(const Record &record);
+    bool openFile();
+    void rotate();
+
+private:
+    Record                  mRing[LOG_RING_SIZE];
+    std::atomic<quint64>    mEnqueuePos;
+    quint64                 mDequeuePos;
+
+    std::atomic<int>        mLevel;
+    std::atomic<int>        mFormat;
+    std::atomic<qint64>     mMaxSize;
+    std::atomic<int>        mMaxFiles;
+    std::atomic<bool>       mReopen;
+    std::atomic<bool>       mRunning;
+    std::atomic<quint64>    mDropped;
+    // the writer blocks on this eventfd while the ring is empty
+    int                     mWakeFd;
+    std::atomic<bool>       mSleeping;
+
+    QByteArray              mPath;
+    FILE*                   mFile;
+    int                     mFileFormat;
+    std::thread             mWriter;
+};
+
+#endif // ASYNCLOGGER_H
@@ -0,0 +1,103 @@
+#include "error-notifier.h"
+
+#include <graceful/log.h>
+#include <graceful/globals.h>
+
+#include <QProcess>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusServiceWatcher>
+#include <QDBusMessage>
+
+#define NOTIFICATIONS_SERVICE   "org.freedesktop.Notifications"
+#define FALLBACK_DELAY_MS       (30 * 1000)
+
+ErrorNotifier::ErrorNotifier(QObject *parent) :
+    QObject(parent),
+    mWatcher(new QDBusServiceWatcher(QSL(NOTIFICATIONS_SERVICE), QDBusConnection::sessionBus(),
+                                     QDBusServiceWatcher::WatchForRegistration, this))
+{
+    connect(mWatcher, &QDBusServiceWatcher::serviceRegistered, this, &ErrorNotifier::flush);
+
+    mFallbackTimer.setSingleShot(true);
+    mFallbackTimer.setInterval(FALLBACK_DELAY_MS);
+    connect(&mFallbackTimer, &QTimer::timeout, this, &ErrorNotifier::fallback);
+}
+
+void ErrorNotifier::report(Severity severity, const QString &title, const QString &text)
+{
+    mQueue << Message{severity, title, text};
+
+    // the caller continues right away, the messages leave from the event loop
+    QTimer::singleShot(0, this, &ErrorNotifier::flush);
+}
+
+void ErrorNotifier::fatal(const QString &title, const QString &text)
+{
+    log_error("%s: %s", title.toUtf8().constData(), text.toUtf8().constData());
+
+    // nothing of the session is left to show it later, and the notification
+    // service is started by the session: the helper's message box outlives us
+    if (!QProcess::startDetached(QSL("graceful-session-ui"), {QSL("--critical"), title, text}))
+        log_error("graceful-session-ui could not show the error");
+}
+
+bool ErrorNotifier::serviceAvailable() const
+{
+    QDBusConnectionInterface* bus = QDBusConnection::sessionBus().interface();
+    return bus && bus->isServiceRegistered(QSL(NOTIFICATIONS_SERVICE));
+}
+
+void ErrorNotifier::flush()
+{
+    if (mQueue.isEmpty())
+        return;
+
+    if (!serviceAvailable()) {
+        if (!mFallbackTimer.isActive())
+            mFallbackTimer.start();
+        return;
+    }
+
+    mFallbackTimer.stop();
+    const QList<Message> queue = mQueue;
+    mQueue.clear();
+    for (const Message &message : queue)
+        notify(message);
+}
+
+void ErrorNotifier::fallback()
+{
+    const QList<Message> queue = mQueue;
+    mQueue.clear();
+    for (const Message &message : queue)
+        showMessageBox(message);
+}
+
+void ErrorNotifier::notify(const Message &message)
+{
+    QVariantMap hints;
+    hints[QSL("urgency")] = QVariant::fromValue<uchar>(message.severity == Critical ? 2 : 1);
+
+    QDBusMessage msg = QDBusMessage::createMethodCall(QSL(NOTIFICATIONS_SERVICE),
+                                                      QSL("/org/freedesktop/Notifications"),
+                                                      QSL(NOTIFICATIONS_SERVICE),
+                                                      QSL("Notify"));
+    msg << QSL("graceful-session")
+        << uint(0)
+        << (message.severity == Critical ? QSL("dialog-error") : QSL("dialog-warning"))
+        << message.title
+        << message.text
+        << QStringList()
+        << hints
+        << int(-1);
+    QDBusConnection::sessionBus().call(msg, QDBus::NoBlock);
+}
+
+void ErrorNotifier::showMessageBox(const Message &message)
+{
+    // the session does not link QtWidgets, the box is shown by the helper
+    const QString severity = message.severity == Critical ? QSL("--critical") : QSL("--warning");
+    if (!QProcess::startDetached(QSL("graceful-session-ui"), {severity, message.title, message.text}))
+        log_error("%s: %s", message.title.toUtf8().constData(), message.text.toUtf8().constData());
+}
@@ -0,0 +1,53 @@
+#ifndef ERRORNOTIFIER_H
+#define ERRORNOTIFIER_H
+
+#include <QObject>
+#include <QList>
+#include <QTimer>
+
+class QDBusServiceWatcher;
+
+/**
+ * @brief Shows startup and supervision errors without blocking.
+ *
+ * Messages go to the freedesktop notification service. While it is not
+ * running (most of the startup) they are queued; if it does not appear in
+ * time they are shown by graceful-session-ui instead.
+ */
+class ErrorNotifier : public QObject
+{
+    Q_OBJECT
+public:
+    enum Severity {
+        Warning,
+        Critical
+    };
+
+    explicit ErrorNotifier(QObject *parent = nullptr);
+
+    void report(Severity severity, const QString &title, const QString &text);
+    // for errors the session quits on: shown right away by a detached helper
+    void fatal(const QString &title, const QString &text);
+
+private Q_SLOTS:
+    void flush();
+    void fallback();
+
+private:
+    struct Message {
+        Severity    severity;
+        QString     title;
+        QString     text;
+    };
+
+    bool serviceAvailable() const;
+    void notify(const Message &message);
+    void showMessageBox(const Message &message);
+
+private:
+    QList<Message>          mQueue;
+    QDBusServiceWatcher*    mWatcher;
+    QTimer                  mFallbackTimer;
+};
+
+#endif // ERRORNOTIFIER_H
@@ -1,35 +1,79 @@
 #include "graceful-modman.h"
+#include "session-settings.h"
+#include "error-notifier.h"
+#include "startup-history.h"
+#include "metrics.h"
 
 #include <graceful/globals.h>
 #include <graceful/settings.h>
 #include <XdgAutoStart>
 #include <XdgDirs>
 #include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <cerrno>
+#include <cstring>
 
 #include <QCoreApplication>
-#include <QMessageBox>
-#include <QSystemTrayIcon>
 #include <QFileInfo>
 #include <QFile>
 #include <QDir>
 #include <QFileSystemWatcher>
 #include <QDateTime>
-#include "wm-select-dialog.h"
+#include <QVector>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QSaveFile>
+#include <QSocketNotifier>
+#include <QPointer>
+#include <QStandardPaths>
+#include <QProcessEnvironment>
+#include <cctype>
+#include <algorithm>
+#include <limits>
 #include "window-manager.h"
-#include <wordexp.h>
+#include "x11-utils.h"
 #include <graceful/log.h>
 
-#include <KF5/KWindowSystem/netwm.h>
-#include <KF5/KWindowSystem/KWindowSystem>
 
-#include <QX11Info>
 
 #define MAX_CRASHES_PER_APP 50
+#define THEME_CHANGE_DELAY_MS 500
+#define DEFAULT_THAW_PRIORITY 100
+#define SESSION_FILE_VERSION 1
+// modules predicted to be ready faster than this are started paced
+#define CHEAP_STARTUP_MS 300
+#define PACED_START_INTERVAL_MS 50
+// descendants must be seen while their parent lives to be attributed
+#define PROCESS_SCAN_INTERVAL_MS 2000
+// signals sent within this long after a scan reuse its result
+#define PROCESS_SCAN_FRESH_MS 100
+#define MEMORY_SAMPLE_INTERVAL_MS (60 * 1000)
+// an over budget module ignoring SIGTERM is killed after this
+#define MEMORY_RESTART_KILL_MS 5000
+// idle phase autostarts wait for the login to settle
+#define IDLE_PHASE_DELAY_MS (15 * 1000)
+// the startup waits for the window manager and the tray, see nativeEventFilter()
+#define ANNOUNCE_POLL_INTERVAL_MS 250
+#define LAG_PROBE_INTERVAL_MS 500
+// all modules are signalled together, each gets this long to quit at logout
+#define LOGOUT_TIMEOUT_MS 5000
+// package managers replace several files, upgrade once they are done
+#define UPGRADE_DELAY_MS 2000
+// a new instance exiting this soon after taking over is rolled back
+#define UPGRADE_ROLLBACK_MS (10 * 1000)
 
 using namespace graceful;
 
 GracefulModuleManager::GracefulModuleManager(QObject* parent) : QObject(parent),
     mThemeWatcher(new QFileSystemWatcher(this)),
+    mErrorNotifier(new ErrorNotifier(this)),
+    mStartupHistory(new StartupHistory(this)),
     mDocker("plank"),
     mBar("graceful-bar"),
     mDaemon("graceful-daemon"),
@@ -38,12 +82,50 @@ GracefulModuleManager::GracefulModuleManager(QObject* parent) : QObject(parent),
     mNetworkPlugin("nm-applet"),
     mTrayStarted(false),
     mWmStarted(false),
+    mBackgroundThrottle(GracefulModule::NoThrottle),
+    mBatteryThrottle(GracefulModule::NoThrottle),
+    mOnBattery(false),
+    mMemoryRestart(false),
+    mUserIdle(false),
+    mBinaryWatcher(new QFileSystemWatcher(this)),
+    mUpgradeOverlap(0),
+    mReexecuted(false),
     mWaitLoop(nullptr)
 {
-    connect(mThemeWatcher, &QFileSystemWatcher::directoryChanged, this, &GracefulModuleManager::themeFolderChanged);
+    // a theme package install fires dozens of events, handle them as one
+    mThemeTimer.setSingleShot(true);
+    mThemeTimer.setInterval(THEME_CHANGE_DELAY_MS);
+    connect(&mThemeTimer, &QTimer::timeout, this, &GracefulModuleManager::themeFolderChanged);
+    connect(mThemeWatcher, &QFileSystemWatcher::directoryChanged, &mThemeTimer, QOverload<>::of(&QTimer::start));
+
+    connect(&mThawTimer, &QTimer::timeout, this, &GracefulModuleManager::thawNext);
+
+    mIdlePhaseTimer.setSingleShot(true);
+    mIdlePhaseTimer.setInterval(IDLE_PHASE_DELAY_MS);
+    connect(&mIdlePhaseTimer, &QTimer::timeout, this, &GracefulModuleManager::startIdlePhaseApps);
+
+    mPaceTimer.setInterval(PACED_START_INTERVAL_MS);
+    connect(&mPaceTimer, &QTimer::timeout, this, &GracefulModuleManager::startNextPaced);
+
+    mProcessScanTimer.setInterval(PROCESS_SCAN_INTERVAL_MS);
+    connect(&mProcessScanTimer, &QTimer::timeout, this, &GracefulModuleManager::scanProcesses);
+    mProcessScanTimer.start();
+
+    mUpgradeTimer.setSingleShot(true);
+    mUpgradeTimer.setInterval(UPGRADE_DELAY_MS);
+    connect(&mUpgradeTimer, &QTimer::timeout, this, &GracefulModuleManager::startUpgrades);
+    connect(mBinaryWatcher, &QFileSystemWatcher::fileChanged, this, &GracefulModuleManager::binaryChanged);
+
+    // a late timer shows how long the event loop was blocked
+    mLagTimer.setInterval(LAG_PROBE_INTERVAL_MS);
+    connect(&mLagTimer, &QTimer::timeout, this, &GracefulModuleManager::measureLag);
+
+    mMemoryTimer.setInterval(MEMORY_SAMPLE_INTERVAL_MS);
+    connect(&mMemoryTimer, &QTimer::timeout, this, &GracefulModuleManager::sampleMemory);
+    mMemoryTimer.start();
 
     qApp->installNativeEventFilter(this);
-    mProcReaper.start();
+    mModuleOutput.start();
 }
 
 void GracefulModuleManager::setWindowManager(const QString & windowManager)
@@ -51,86 +133,307 @@ void GracefulModuleManager::setWindowManager(const QString & windowManager)
     Q_UNUSED(windowManager);
 }
 
-void GracefulModuleManager::startup(Settings& s)
+void GracefulModuleManager::startup(const SessionSettings& s)
 {
 //    startConfUpdate();
 
-    // Start window manager
-    startWm();
+    mStartupHistory->load();
+
+    // after adoptState(), the pids of adopted modules are watched by now
+    if (!mProcReaper.isRunning())
+        mProcReaper.start();
+
+    // Start window manager, everything else needs it
+    if (!startWm())
+        return;
+
+    // the order of these only matters on the first login, later the
+    // learned readiness times decide
+    schedule(mDocker, [this] { startDocker(); });
+    schedule(mDesktop, [this] { startDesktop(); });
+    schedule(mBar, [this] { startBar(); });
+
+    // the autostart entries keep their place between the bar and the
+    // network plugin; the tray apps wait for the bar started below
+    const XdgDesktopFileList trayApps = scheduleAutostartApps();
+
+    schedule(mNetworkPlugin, [this] { startNetworkPlugin(); });
+    schedule(mDaemon, [this] { startDaemon(); });
+
+    runSchedule();
+    if (!mIdlePhaseApps.isEmpty())
+        mIdlePhaseTimer.start();
+
+    startTrayApps(trayApps);
+
+    // installed or removed themes and edits of the current one are
+    // announced as themeUpdated
+    QStringList paths;
+    paths << XdgDirs::dataHome(false);
+    paths << XdgDirs::dataDirs();
+    for (const QString &path : qAsConst(paths)) {
+        QFileInfo fi(QString::fromLatin1("%1/graceful/themes").arg(path));
+        if (fi.exists()) {
+            log_debug("get theme path: %s", fi.absoluteFilePath().toUtf8().constData());
+            mThemeWatcher->addPath(fi.absoluteFilePath());
+        }
+    }
+
+    themeChanged();
+}
+
+/**
+* @brief module name as used by startProcess(), the first word of Exec
+**/
+static QString module_name(const XdgDesktopFile& file)
+{
+    return file.value(QSL("Exec")).toString().split(QLatin1Char(' ')).first();
+}
+
+// the desktop file keys of modules, adopted modules have no GracefulModule
+static bool is_background(const XdgDesktopFile& file)
+{
+    return file.value(QL1S("X-Graceful-Background"), false).toBool();
+}
+
+static bool freezes_on_sleep(const XdgDesktopFile& file)
+{
+    return file.value(QL1S("X-Graceful-Freeze-On-Sleep"), false).toBool();
+}
+
+static int thaw_priority(const XdgDesktopFile& file)
+{
+    return file.value(QL1S("X-Graceful-Thaw-Priority"), DEFAULT_THAW_PRIORITY).toInt();
+}
+
+static qint64 memory_budget(const XdgDesktopFile& file)
+{
+    // given in MiB
+    return file.value(QL1S("X-Graceful-Memory-Budget"), 0).toLongLong() * 1024;
+}
+
+static QString module_executable(const XdgDesktopFile& file)
+{
+    const QStringList args = file.expandExecString();
+    return args.isEmpty() ? QString() : QStandardPaths::findExecutable(args.first());
+}
+
+/**
+* @brief switches every thread of the processes to the given scheduling
+* policy, false if one of them refused; vanished processes do not count
+**/
+static bool set_sched_policy(const QList<qint64>& pids, int policy)
+{
+    bool ret = true;
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    for (qint64 pid : pids) {
+        QDir tasks(QSL("/proc/%1/task").arg(pid));
+        const QStringList tids = tasks.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+        for (const QString& tid : tids) {
+            if (sched_setscheduler(tid.toInt(), policy, &param) != 0 && errno != ESRCH) {
+                log_warn("sched_setscheduler %s: %s", tid.toUtf8().constData(), strerror(errno));
+                ret = false;
+            }
+        }
+    }
+    return ret;
+}
 
-    // start plank
-    startDocker();
+/**
+* @brief moves the process group led by pid from current to throttle;
+* throttled holds the processes moved to SCHED_BATCH, shared by modules
+* and adopted modules
+**/
+static bool apply_throttle(const QString& name, pid_t pid, GracefulModule::Throttle& current,
+                           QList<qint64>& throttled, GracefulModule::Throttle throttle, const QList<qint64>& group)
+{
+    if (throttle == current)
+        return true;
+
+    switch (current) {
+    case GracefulModule::Frozen:
+        ::kill(-pid, SIGCONT);
+        break;
+    case GracefulModule::IdlePriority:
+        // SCHED_BATCH can always be left again, SCHED_IDLE would need
+        // RLIMIT_NICE; processes forked since inherited it
+        for (qint64 member : group) {
+            if (!throttled.contains(member))
+                throttled << member;
+        }
+        if (!set_sched_policy(throttled, SCHED_OTHER)) {
+            log_warn("module %s: the priority throttle could not be lifted", name.toUtf8().constData());
+            return false;
+        }
+        throttled.clear();
+        break;
+    case GracefulModule::NoThrottle:
+        break;
+    }
 
-    // start desktop
-    startDesktop();
+    switch (throttle) {
+    case GracefulModule::Frozen:
+        ::kill(-pid, SIGSTOP);
+        break;
+    case GracefulModule::IdlePriority:
+        throttled = group;
+        if (!throttled.contains(pid))
+            throttled.prepend(pid);
+        set_sched_policy(throttled, SCHED_BATCH);
+        break;
+    case GracefulModule::NoThrottle:
+        break;
+    }
 
-    // start bar
-    startBar();
+    log_debug("module %s throttle %d", name.toUtf8().constData(), throttle);
+    current = throttle;
+    return true;
+}
 
-    // start apps
-    startAutostartApps();
+/**
+* @brief output ring and process tree entry of a new version during its
+* upgrade overlap, the module's own ones belong to the running instance
+**/
+static QString candidate_key(const QString& name)
+{
+    return name + QSL("@new");
+}
 
-    // start network manager plugin
-    startNetworkPlugin();
+void GracefulModuleManager::schedule(const QString& name, const std::function<void()>& start)
+{
+    mPendingStarts << PendingStart{name, start};
+}
 
-    // start daemon
-    startDaemon();
+void GracefulModuleManager::runSchedule()
+{
+    // unknown modules count as expensive, stable_sort keeps their order
+    auto cost = [this](const PendingStart& p) {
+        const qint64 ms = mStartupHistory->predicted(p.name);
+        return ms < 0 ? std::numeric_limits<qint64>::max() : ms;
+    };
+    std::stable_sort(mPendingStarts.begin(), mPendingStarts.end(), [&cost](const PendingStart& a, const PendingStart& b) {
+        return cost(a) > cost(b);
+    });
+
+    // the longest ones are on the critical path and start right away
+    for (const PendingStart& p : qAsConst(mPendingStarts)) {
+        if (cost(p) >= CHEAP_STARTUP_MS)
+            p.start();
+        else
+            mPacedStarts << p;
+    }
+    mPendingStarts.clear();
 
+    if (!mPacedStarts.isEmpty())
+        mPaceTimer.start();
+}
 
-//    QStringList paths;
-//    paths << XdgDirs::dataHome(false);
-//    paths << XdgDirs::dataDirs();
+void GracefulModuleManager::startNextPaced()
+{
+    if (!mPacedStarts.isEmpty())
+        mPacedStarts.takeFirst().start();
 
-    // FIXME://
-//    for(const QString &path : qAsConst(paths)) {
-//        QFileInfo fi(QString::fromLatin1("%1/graceful/themes").arg(path));
-//        if (fi.exists()) {
-//            log_debug("get theme path: %s", fi.absoluteFilePath().toUtf8().constData());
-//            mThemeWatcher->addPath(fi.absoluteFilePath());
-//        }
-//    }
+    if (mPacedStarts.isEmpty())
+        mPaceTimer.stop();
+}
 
-//    themeChanged();
+QStringList GracefulModuleManager::startupTimings() const
+{
+    return mStartupHistory->report();
 }
 
-void GracefulModuleManager::startAutostartApps()
+XdgDesktopFileList GracefulModuleManager::scheduleAutostartApps()
 {
     log_debug("XDG autostart ...");
     const XdgDesktopFileList fileList = XdgAutoStart::desktopFileList();
-    QList<const XdgDesktopFile*> trayApps;
+    XdgDesktopFileList trayApps;
     for (XdgDesktopFileList::const_iterator i = fileList.constBegin(); i != fileList.constEnd(); ++i) {
         if (mNameMap.contains(i->name())) {
             log_debug("progress '%s' has started!", i->name().toUtf8().constData());
             continue;
         }
 
-        if (i->value(QSL("X-Graceful-Need-Tray"), false).toBool()) {
+        if (i->value(QSL("X-Graceful-Autostart-Phase")).toString().compare(QL1S("Idle"), Qt::CaseInsensitive) == 0) {
+            mIdlePhaseApps << *i;
+        } else if (i->value(QSL("X-Graceful-Need-Tray"), false).toBool()) {
             log_debug("autostart file name with tray: %s", i->fileName().toUtf8().constData());
-            trayApps.append(&(*i));
+            trayApps << *i;
         } else {
-            startProcess(*i);
-            log_debug("start %s", i->fileName().toUtf8().constData());
+            const XdgDesktopFile file = *i;
+            schedule(module_name(file), [this, file] {
+                startProcess(file);
+                log_debug("start %s", file.fileName().toUtf8().constData());
+            });
         }
     }
 
-    if (!trayApps.isEmpty()) {
-        mTrayStarted = QSystemTrayIcon::isSystemTrayAvailable();
-        if(!mTrayStarted) {
-            QEventLoop waitLoop;
-            mWaitLoop = &waitLoop;
-            // add a timeout to avoid infinite blocking if a WM fail to execute.
-            QTimer::singleShot(60 * 1000, &waitLoop, SLOT(quit()));
-            waitLoop.exec();
-            mWaitLoop = nullptr;
-        }
-        for (const XdgDesktopFile* const f : qAsConst(trayApps)) {
-            log_debug("start tray app %s", f->fileName().toUtf8().constData());
-            startProcess(*f);
-        }
+    return trayApps;
+}
+
+void GracefulModuleManager::startTrayApps(const XdgDesktopFileList& trayApps)
+{
+    if (trayApps.isEmpty())
+        return;
+
+    mTrayStarted = x11_system_tray_running();
+    if(!mTrayStarted) {
+        QEventLoop waitLoop;
+        mWaitLoop = &waitLoop;
+        // add a timeout to avoid infinite blocking if a WM fail to execute.
+        QTimer::singleShot(60 * 1000, &waitLoop, SLOT(quit()));
+        // the MANAGER message goes to root clients with StructureNotify
+        // selected, which the session may not be: poll as well
+        QTimer trayPoll;
+        trayPoll.setInterval(ANNOUNCE_POLL_INTERVAL_MS);
+        connect(&trayPoll, &QTimer::timeout, this, [this] {
+            if (!mTrayStarted && x11_system_tray_running())
+                trayStarted();
+        });
+        trayPoll.start();
+        waitLoop.exec();
+        mWaitLoop = nullptr;
+    }
+    for (const XdgDesktopFile& f : trayApps) {
+        log_debug("start tray app %s", f.fileName().toUtf8().constData());
+        startProcess(f);
+    }
+}
+
+void GracefulModuleManager::startIdlePhaseApps()
+{
+    if (mOnBattery) {
+        log_debug("on battery, %d idle phase autostarts wait for AC", mIdlePhaseApps.size());
+        return;
+    }
+
+    for (const XdgDesktopFile& file : qAsConst(mIdlePhaseApps)) {
+        schedule(module_name(file), [this, file] {
+            startProcess(file);
+            log_debug("start %s", file.fileName().toUtf8().constData());
+        });
+    }
+    mIdlePhaseApps.clear();
+    runSchedule();
+}
+
+/**
+ * @brief flush one file and the directory entry of its atomic rename
+ **/
+static void sync_file(const QString& path)
+{
+    const QByteArray paths[] = {QFile::encodeName(path), QFile::encodeName(QFileInfo(path).absolutePath())};
+    for (const QByteArray& p : paths) {
+        int fd = ::open(p.constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        if (::fsync(fd) != 0)
+            log_debug("fsync %s failed", p.constData());
+        ::close(fd);
     }
 }
 
-void GracefulModuleManager::themeFolderChanged(const QString& /*path*/)
+void GracefulModuleManager::themeFolderChanged()
 {
     QString newTheme;
     if (!QFileInfo::exists(mCurrentThemePath)) {
@@ -152,7 +455,13 @@ void GracefulModuleManager::themeFolderChanged(const QString& /*path*/)
     else
         settings.setValue(QL1S("theme"), newTheme);
 
-    sync();
+    // QSettings saves through an atomic rename, only that file needs to hit the disk
+    settings.sync();
+    sync_file(settings.fileName());
+
+    // the current theme may have moved, watch where it is now
+    themeChanged();
+    Q_EMIT themeUpdated(newTheme);
 }
 
 void GracefulModuleManager::themeChanged()
@@ -166,17 +475,17 @@ void GracefulModuleManager::themeChanged()
     }
 }
 
-void GracefulModuleManager::startWm()
+bool GracefulModuleManager::startWm()
 {
-    if (!QString::fromUtf8(NETRootInfo(QX11Info::connection(), NET::SupportingWMCheck).wmName()).isEmpty()) {
+    if (x11_window_manager_running()) {
         mWmStarted = true;
-        return;
+        return true;
     }
 
     if (!findProgram(mWindowManager)) {
-        QMessageBox::critical(nullptr, tr("windows manager error!"), "Window Manager 'graceful-wm' not found!", QMessageBox::Ok);
-        log_error("window manager '%s' not found!", mWindowManager.toUtf8().constData());
+        mErrorNotifier->fatal(tr("windows manager error!"), tr("Window Manager '%1' not found!").arg(mWindowManager));
         qApp->exit(-1);
+        return false;
     }
 
     log_debug("window manager '%s' start...", mWindowManager.toUtf8().constData());
@@ -191,15 +500,26 @@ void GracefulModuleManager::startWm()
     mWaitLoop = &waitLoop;
     // add a timeout to avoid infinite blocking if a WM fail to execute.
     QTimer::singleShot(30 * 1000, &waitLoop, SLOT(quit()));
+    // a window manager may name its check window after announcing it
+    QTimer wmPoll;
+    wmPoll.setInterval(ANNOUNCE_POLL_INTERVAL_MS);
+    connect(&wmPoll, &QTimer::timeout, &waitLoop, [this, &waitLoop] {
+        if (x11_window_manager_running()) {
+            mWmStarted = true;
+            waitLoop.exit();
+        }
+    });
+    wmPoll.start();
     waitLoop.exec();
     mWaitLoop = nullptr;
+    return true;
 }
 
 void GracefulModuleManager::startBar()
 {
     log_info ("start load graceful-bar...");
     if (!findProgram(mBar)) {
-        QMessageBox::critical(nullptr, tr("graceful bar error!"), "'graceful-wm' not found!", QMessageBox::Ok);
+        mErrorNotifier->report(ErrorNotifier::Critical, tr("graceful bar error!"), tr("Bar '%1' not found!").arg(mBar));
         log_error("graceful bar '%s' not found!", mBar.toUtf8().constData());
         return;
     }
@@ -215,7 +535,7 @@ void GracefulModuleManager::startDocker()
     log_info ("start graceful-docker ...");
 
     if (!findProgram(mDocker)) {
-        QMessageBox::critical(nullptr, tr("graceful docker error!"), tr("'%1' not found!").arg(mDocker), QMessageBox::Ok);
+        mErrorNotifier->report(ErrorNotifier::Critical, tr("graceful docker error!"), tr("'%1' not found!").arg(mDocker));
         log_error("'%s' not found!", mDocker.toUtf8().constData());
         return;
     }
@@ -231,7 +551,7 @@ void GracefulModuleManager::startDaemon()
     log_info ("start graceful-daemon ...");
 
     if (!findProgram(mDaemon)) {
-        QMessageBox::critical(nullptr, tr("graceful daemon error!"), tr("'%1' not found!").arg(mDaemon), QMessageBox::Ok);
+        mErrorNotifier->report(ErrorNotifier::Critical, tr("graceful daemon error!"), tr("'%1' not found!").arg(mDaemon));
         log_error("'%s' not found!", mDaemon.toUtf8().constData());
         return;
     }
@@ -247,7 +567,7 @@ void GracefulModuleManager::startDesktop()
     log_info ("start graceful-desktop ...");
 
     if (!findProgram(mDesktop)) {
-        QMessageBox::critical(nullptr, tr("graceful desktop error!"), tr("'%1' not found!").arg(mDesktop), QMessageBox::Ok);
+        mErrorNotifier->report(ErrorNotifier::Critical, tr("graceful desktop error!"), tr("'%1' not found!").arg(mDesktop));
         log_error("'%s' not found!", mDesktop.toUtf8().constData());
         return;
     }
@@ -262,7 +582,7 @@ void GracefulModuleManager::startNetworkPlugin()
 {
     log_info ("start load graceful-nm-applet...");
     if (!findProgram(mNetworkPlugin)) {
-        QMessageBox::critical(nullptr, tr("graceful-nm-applet error!"), "'graceful-nm-applet' not found!", QMessageBox::Ok);
+        mErrorNotifier->report(ErrorNotifier::Critical, tr("graceful-nm-applet error!"), "'graceful-nm-applet' not found!");
         log_error("graceful-nm-applet '%s' not found!", mNetworkPlugin.toUtf8().constData());
         return;
     }
@@ -276,7 +596,9 @@ void GracefulModuleManager::startNetworkPlugin()
 void GracefulModuleManager::startProcess(const XdgDesktopFile& file)
 {
     if (!file.value(QL1S("X-Graceful-Module"), false).toBool()) {
-        file.startDetached();
+        // autostart applications of a re-executed session are still running
+        if (!mReexecuted)
+            startDetached(file);
         return;
     }
     QStringList args = file.expandExecString();
@@ -284,227 +606,1485 @@ void GracefulModuleManager::startProcess(const XdgDesktopFile& file)
         log_debug("Wrong desktop file %s", file.fileName().toUtf8().constData());
         return;
     }
-    GracefulModule* proc = new GracefulModule(file, this);
-    connect(proc, &GracefulModule::moduleStateChanged, this, &GracefulModuleManager::moduleStateChanged);
-    proc->start();
-
     //
     QString name = file.value("Exec").toString().split(' ').first();
     if (name.isEmpty()) {
         log_debug("invalid desktop file '%s', exec is null", file.fileName().toUtf8().constData());
         return;
     }
-    mNameMap[name] = proc;
 
-    connect(proc, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &GracefulModuleManager::restartModules);
+    if (mAdopted.contains(name))
+        return;
+
+    GracefulModule* proc = launchModule(file, name);
+    mNameMap[name] = proc;
+    if (!mStartOrder.contains(name))
+        mStartOrder << name;
+    watchBinary(proc->executable());
 }
 
-void GracefulModuleManager::startProcess(const QString& name)
+/**
+* @brief starts an autostart application outside of the module table; the
+* startup history measures it like a module when its pid is known
+**/
+void GracefulModuleManager::startDetached(const XdgDesktopFile& file)
 {
-    if (!mNameMap.contains(name)) {
-        const auto files = XdgAutoStart::desktopFileList(false);
-        for (const XdgDesktopFile& file : files) {
-            if (QFileInfo(file.fileName()).fileName() == name) {
-                startProcess(file);
-                return;
-            }
-        }
+    QStringList args = file.expandExecString();
+    // terminal and D-Bus activated entries need XdgDesktopFile, which hides the pid
+    if (args.isEmpty() || file.value(QL1S("Terminal"), false).toBool() || file.value(QL1S("DBusActivatable"), false).toBool()) {
+        file.startDetached();
+        return;
+    }
+
+    const QString command = args.takeFirst();
+    const QString program = command.contains(QLatin1Char('/')) ? command : QStandardPaths::findExecutable(command);
+    if (program.isEmpty()) {
+        log_warn("autostart %s: '%s' not found", file.fileName().toUtf8().constData(), command.toUtf8().constData());
+        return;
     }
+
+    QString cwd = file.value(QL1S("Path")).toString();
+    if (!QFileInfo(cwd).isDir())
+        cwd.clear();
+
+    const qint64 pid = spawnDetached(program, args, QMap<QByteArray, QByteArray>(), cwd);
+    if (pid > 0)
+        mStartupHistory->track(module_name(file), pid);
 }
 
-void GracefulModuleManager::stopProcess(const QString& name)
+GracefulModule* GracefulModuleManager::launchModule(const XdgDesktopFile& file, const QString& name, int programFd,
+                                                    const QString& outputName)
 {
-    if (mNameMap.contains(name))
-        mNameMap[name]->terminate();
+    GracefulModule* proc = new GracefulModule(file, this);
+    connect(proc, &GracefulModule::moduleStateChanged, this, &GracefulModuleManager::moduleStateChanged);
+    connect(proc, &QProcess::started, this, [this, proc, name] {
+        ++Metrics::spawns;
+        if (proc->restartTimer.isValid()) {
+            Metrics::restartLatency.observe(proc->restartTimer.nsecsElapsed() / 1000);
+            proc->restartTimer.invalidate();
+        }
+        mStartupHistory->track(name, proc->processId());
+        mProcReaper.expect(static_cast<pid_t>(proc->processId()));
+        // a module restarted while idle or on battery is throttled right away
+        proc->setThrottle(backgroundThrottle(name, proc->file));
+    });
+    proc->setOutput(&mModuleOutput, name);
+    if (!outputName.isEmpty())
+        proc->setOutputName(outputName);
+    if (programFd >= 0)
+        proc->setProgramFd(programFd);
+    proc->start();
+
+    connect(proc, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &GracefulModuleManager::restartModules);
+    return proc;
 }
 
-QStringList GracefulModuleManager::listModules() const
+void GracefulModuleManager::watchBinary(const QString& executable)
 {
-    return QStringList(mNameMap.keys());
+    if (mUpgradeOverlap > 0 && !executable.isEmpty() && !mBinaryWatcher->files().contains(executable))
+        mBinaryWatcher->addPath(executable);
 }
 
-void GracefulModuleManager::startConfUpdate()
+void GracefulModuleManager::environmentChanged()
 {
-    XdgDesktopFile desktop(XdgDesktopFile::ApplicationType, QSL(":graceful-confupdate"), QSL("graceful-confupdate --watch"));
-    desktop.setValue(QSL("Name"), QSL("Graceful config updater"));
-    desktop.setValue(QL1S("X-Graceful-Module"), true);
-    startProcess(desktop);
+    for (GracefulModule* p : qAsConst(mNameMap))
+        p->resetExecArgs();
 }
 
-void GracefulModuleManager::restartModules(int /*exitCode*/, QProcess::ExitStatus exitStatus)
+void GracefulModuleManager::setUpgradeOverlap(int overlap)
 {
-    GracefulModule* proc = qobject_cast<GracefulModule*>(sender());
-    if (nullptr == proc) {
-        log_warn("Got an invalid (null) module to restart. Ignoring it");
+    mUpgradeOverlap = overlap;
+    if (mUpgradeOverlap <= 0) {
+        if (!mBinaryWatcher->files().isEmpty())
+            mBinaryWatcher->removePaths(mBinaryWatcher->files());
         return;
     }
 
-    if (!proc->isTerminating()) {
-        QString procName = proc->file.name();
-        switch (exitStatus) {
-        case QProcess::NormalExit:
-            log_debug("Process %s exited correctly.", procName.toUtf8().constData());
-            break;
-        case QProcess::CrashExit: {
-            log_debug("Process %s has to be restarted", procName.toUtf8().constData());
-            time_t now = time(nullptr);
-            mCrashReport[proc].prepend(now);
-            while (now - mCrashReport[proc].back() > 60)
-                mCrashReport[proc].pop_back();
-            if (mCrashReport[proc].length() >= MAX_CRASHES_PER_APP) {
-                QMessageBox::warning(nullptr, tr("Crash Report"), tr("<b>%1</b> crashed too many times. Its autorestart has been disabled until next login.").arg(procName));
-            } else {
-                proc->start();
-                return;
-            }
-            break;
-        }
-        }
-    }
-    mNameMap.remove(proc->fileName);
-    proc->deleteLater();
+    for (const GracefulModule* p : qAsConst(mNameMap))
+        watchBinary(p->executable());
+    for (const AdoptedModule& m : qAsConst(mAdopted))
+        watchBinary(module_executable(m.file));
 }
 
-
-GracefulModuleManager::~GracefulModuleManager()
+void GracefulModuleManager::binaryChanged(const QString& path)
 {
-    qApp->removeNativeEventFilter(this);
+    if (!mChangedBinaries.contains(path))
+        mChangedBinaries << path;
+    mUpgradeTimer.start();
+}
 
-    // We disconnect the finished signal before deleting the process. We do
-    // this to prevent a crash that results from a state change signal being
-    // emmited while deleting a crashing module.
-    // If the module is still connect restartModules will be called with a
-    // invalid sender.
+void GracefulModuleManager::startUpgrades()
+{
+    const QStringList changed = mChangedBinaries;
+    mChangedBinaries.clear();
 
-    ModulesMapIterator i(mNameMap);
-    while (i.hasNext()) {
-        i.next();
+    for (const QString& path : changed) {
+        // a replaced file drops out of the watcher, the new one is watched again
+        if (!QFileInfo(path).isExecutable())
+            continue;
+        mBinaryWatcher->addPath(path);
+
+        const QList<GracefulModule*> modules = mNameMap.values();
+        for (GracefulModule* old : modules) {
+            if (old->executable() != path || old->state() != QProcess::Running || mUpgrades.contains(old->name()))
+                continue;
+
+            // the replaced binary stays reachable through the running process,
+            // an open fd keeps it for a rollback without copying it anywhere
+            const QString name = old->name();
+            const int rollbackFd = ::open(QFile::encodeName(QSL("/proc/%1/exe").arg(old->processId())).constData(), O_RDONLY | O_CLOEXEC);
+            if (rollbackFd < 0)
+                log_warn("no rollback for %s: %s", name.toUtf8().constData(), strerror(errno));
+
+            if (old->isSingleInstance() || mSingleInstance.contains(name)) {
+                restartForUpgrade(old, rollbackFd);
+                continue;
+            }
 
-        auto p = i.value();
-        disconnect(p);
+            log_info("module %s changed on disk, starting the new version", name.toUtf8().constData());
+            mUpgrades.insert(name, Upgrade{old, launchModule(old->file, name, -1, candidate_key(name)), rollbackFd, false});
+            QTimer::singleShot(mUpgradeOverlap, this, [this, name] { finishUpgrade(name); });
+        }
 
-        delete p;
-        mNameMap[i.key()] = nullptr;
+        // no overlap and no rollback, the new binary runs once they are gone
+        const QStringList adopted = mAdopted.keys();
+        for (const QString& name : adopted) {
+            const AdoptedModule& m = mAdopted[name];
+            if (m.restarting || module_executable(m.file) != path)
+                continue;
+            log_info("module %s changed on disk, restarting it", name.toUtf8().constData());
+            restartAdopted(name, LOGOUT_TIMEOUT_MS);
+        }
     }
 }
 
 /**
-* @brief this logs us out by terminating our session
+* @brief a second instance of a single instance module would only hand over
+* to the running one, so the old instance is stopped before the new one starts
 **/
-void GracefulModuleManager::logout(bool doExit)
+void GracefulModuleManager::restartForUpgrade(GracefulModule* old, int rollbackFd)
 {
-    // modules
-    ModulesMapIterator i(mNameMap);
-    while (i.hasNext()) {
-        i.next();
-        log_debug("Module logout %s", i.key().toUtf8().constData());
-        GracefulModule* p = i.value();
-        p->terminate();
-    }
-    i.toFront();
-    while (i.hasNext()) {
-        i.next();
-        GracefulModule* p = i.value();
-        if (p->state() != QProcess::NotRunning && !p->waitForFinished(2000)) {
-            log_debug("Module %s won't terminate ... killing.", qPrintable(i.key()));
-            p->kill();
-        }
-    }
+    const QString name = old->name();
+    log_info("module %s changed on disk, restarting it", name.toUtf8().constData());
+    mUpgrades.insert(name, Upgrade{old, nullptr, rollbackFd, false});
+
+    // through the restart path, handleUpgradeExit() starts the new binary
+    const pid_t pid = static_cast<pid_t>(old->processId());
+    old->restart();
+    ::kill(-pid, SIGTERM);
+    QPointer<GracefulModule> guard(old);
+    QTimer::singleShot(LOGOUT_TIMEOUT_MS, this, [guard] {
+        if (guard && guard->state() != QProcess::NotRunning)
+            guard->kill();
+    });
+}
 
-    if (doExit) {
-        QCoreApplication::exit(0);
+void GracefulModuleManager::finishUpgrade(const QString& name)
+{
+    auto it = mUpgrades.find(name);
+    if (it == mUpgrades.end() || it->swapped || !it->candidate)
+        return;
+
+    // the new instance made it through the overlap, the old one retires
+    GracefulModule* old = it->old;
+    it->swapped = true;
+    mNameMap[name] = it->candidate;
+    mModuleOutput.rename(candidate_key(name), name);
+    it->candidate->setOutputName(name);
+    if (old->state() != QProcess::NotRunning) {
+        const pid_t pid = static_cast<pid_t>(old->processId());
+        old->terminate();
+        ::kill(-pid, SIGTERM);
     }
+    log_info("module %s upgraded", name.toUtf8().constData());
+    armRollback(name);
 }
 
-QString GracefulModuleManager::showWmSelectDialog()
+/**
+* @brief the replaced binary is kept for a while in case the new one exits
+**/
+void GracefulModuleManager::armRollback(const QString& name)
 {
-    WindowManagerList availableWM = getWindowManagerList(true);
-    if (availableWM.count() == 1)
-        return availableWM.at(0).command;
-
-    WMSelectDialog dlg(availableWM);
-    dlg.exec();
-    return dlg.windowManager();
+    const GracefulModule* candidate = mUpgrades.value(name).candidate;
+    QTimer::singleShot(UPGRADE_ROLLBACK_MS, this, [this, name, candidate] {
+        const auto it = mUpgrades.find(name);
+        if (it != mUpgrades.end() && it->swapped && it->candidate == candidate) {
+            if (it->rollbackFd >= 0)
+                ::close(it->rollbackFd);
+            mUpgrades.erase(it);
+        }
+    });
 }
 
-void GracefulModuleManager::resetCrashReport()
+/**
+* @brief stops the new instances which are still in their overlap and drops
+* the kept binaries, the old instances are left to the logout
+**/
+void GracefulModuleManager::abortUpgrades()
 {
-    mCrashReport.clear();
+    // the new instances are not in the module table yet
+    for (auto it = mUpgrades.constBegin(); it != mUpgrades.constEnd(); ++it) {
+        const Upgrade& u = it.value();
+        if (!u.swapped && u.candidate) {
+            u.candidate->terminate();
+            signalModuleTree(candidate_key(it.key()), SIGTERM, false);
+            u.candidate->waitForFinished(LOGOUT_TIMEOUT_MS / 10);
+        }
+        if (u.rollbackFd >= 0)
+            ::close(u.rollbackFd);
+    }
+    mUpgrades.clear();
 }
 
-bool GracefulModuleManager::nativeEventFilter(const QByteArray & eventType, void * /*message*/, long * /*result*/)
+/**
+* @brief handles the exit of either instance while an upgrade is not done,
+* true if the exit was taken care of
+**/
+bool GracefulModuleManager::handleUpgradeExit(GracefulModule* proc)
 {
-    if (eventType != "xcb_generic_event_t") // We only want to handle XCB events
+    const QString name = proc->name();
+    auto it = mUpgrades.find(name);
+    if (it == mUpgrades.end() || proc->isTerminating())
         return false;
 
-    if(!mWmStarted && mWaitLoop) {
-        // all window managers must set their name according to the spec
-        if (!QString::fromUtf8(NETRootInfo(QX11Info::connection(), NET::SupportingWMCheck).wmName()).isEmpty()) {
-            log_debug("Window Manager started");
-            mWmStarted = true;
-            if (mWaitLoop->isRunning())
-                mWaitLoop->exit();
+    if (it->old == proc && !it->swapped) {
+        if (it->candidate) {
+            // the old instance went away by itself, the new one takes over now
+            finishUpgrade(name);
+        } else {
+            // a single instance module stopped, its new binary starts now
+            it->candidate = launchModule(proc->file, name);
+            it->swapped = true;
+            mNameMap[name] = it->candidate;
+            log_info("module %s restarted with its new binary", name.toUtf8().constData());
+            armRollback(name);
         }
+        proc->deleteLater();
+        return true;
     }
+    if (it->candidate != proc)
+        return false;
 
-    if (!mTrayStarted && QSystemTrayIcon::isSystemTrayAvailable() && mWaitLoop) {
-        log_debug("System Tray started");
-        mTrayStarted = true;
-        if (mWaitLoop->isRunning())
-            mWaitLoop->exit();
+    const Upgrade upgrade = *it;
+    mUpgrades.erase(it);
+    proc->deleteLater();
 
-        // window manager and system tray have started
-        qApp->removeNativeEventFilter(this);
+    if (!upgrade.swapped) {
+        if (proc->exitStatus() == QProcess::NormalExit && proc->exitCode() == 0 && upgrade.old->state() == QProcess::Running) {
+            // a guess: a clean exit next to the running instance looks like
+            // a hand over to it, a module which just quits early is taken
+            // for single instance as well and gets restarted on upgrades
+            log_info("new version of %s exited cleanly during the overlap, restarting the module instead",
+                     name.toUtf8().constData());
+            mSingleInstance.insert(name);
+            restartForUpgrade(upgrade.old, upgrade.rollbackFd);
+            return true;
+        }
+        // the old instance never stopped, nothing is lost
+        log_warn("new version of %s exited during the overlap, keeping the running one", name.toUtf8().constData());
+        if (upgrade.rollbackFd >= 0)
+            ::close(upgrade.rollbackFd);
+        return true;
     }
 
-    return false;
+    log_warn("new version of %s exited right after the upgrade, rolling back", name.toUtf8().constData());
+    if (mNameMap.value(name) == proc)
+        mNameMap[name] = launchModule(proc->file, name, upgrade.rollbackFd);
+    else if (upgrade.rollbackFd >= 0)
+        ::close(upgrade.rollbackFd);
+    return true;
 }
 
-void graceful_setenv(const char *env, const QByteArray &value)
+void GracefulModuleManager::startProcess(const QString& name)
 {
-    wordexp_t p;
-    wordexp(value.constData(), &p, 0);
-    if (p.we_wordc == 1) {
-        log_debug("Environment variable %s=%s", env, p.we_wordv[0]);
-        qputenv(env, p.we_wordv[0]);
-    } else {
-        log_debug("Error expanding environment variable %s=%s", env, value.toStdString().c_str());
-        qputenv(env, value);
+    if (!mNameMap.contains(name)) {
+        const auto files = XdgAutoStart::desktopFileList(false);
+        for (const XdgDesktopFile& file : files) {
+            if (QFileInfo(file.fileName()).fileName() == name) {
+                startProcess(file);
+                return;
+            }
+        }
     }
-    wordfree(&p);
 }
 
-void graceful_setenv_prepend(const char *env, const QByteArray &value, const QByteArray &separator)
+/**
+* @brief signals a module's process group (see setupChildProcess); what left
+* the group, like the applications a launcher started with setsid(), is
+* spared, only the logout takes the whole tree down
+**/
+static void signal_group(qint64 group, int sig)
 {
-    QByteArray orig(qgetenv(env));
-    orig = orig.prepend(separator);
-    orig = orig.prepend(value);
-    log_debug("Setting special %s=%s", env, orig.toStdString().c_str());
-    graceful_setenv(env, orig);
+    if (group > 0)
+        ::kill(-static_cast<pid_t>(group), sig);
 }
 
-GracefulModule::GracefulModule(const XdgDesktopFile& file, QObject* parent) :
-    QProcess(parent),
-    file(file),
-    fileName(QFileInfo(file.fileName()).fileName()),
-    mIsTerminating(false)
+void GracefulModuleManager::stopProcess(const QString& name)
 {
-    QProcess::setProcessChannelMode(QProcess::ForwardedChannels);
-    connect(this, &GracefulModule::stateChanged, this, &GracefulModule::updateState);
+    if (mNameMap.contains(name)) {
+        mNameMap[name]->terminate();
+        signal_group(mNameMap[name]->processGroup(), SIGTERM);
+    } else if (mAdopted.contains(name)) {
+        AdoptedModule& m = mAdopted[name];
+        m.terminating = true;
+        // a stopped process would never see the SIGTERM
+        apply_throttle(name, static_cast<pid_t>(m.pid), m.throttle, m.throttled, GracefulModule::NoThrottle, QList<qint64>());
+        signal_group(m.pid, SIGTERM);
+    }
 }
 
-void GracefulModule::start()
+void GracefulModuleManager::scanProcesses()
 {
-    mIsTerminating = false;
-    QStringList args = file.expandExecString();
-    QString command = args.takeFirst();
-    QProcess::start(command, args);
+    MetricsScope scope(Metrics::processScan);
+    QHash<QString, qint64> roots;
+    for (auto it = mNameMap.constBegin(); it != mNameMap.constEnd(); ++it) {
+        if (it.value() && it.value()->state() == QProcess::Running)
+            roots.insert(it.key(), it.value()->processId());
+    }
+    for (auto it = mAdopted.constBegin(); it != mAdopted.constEnd(); ++it)
+        roots.insert(it.key(), it->pid);
+    for (auto it = mUpgrades.constBegin(); it != mUpgrades.constEnd(); ++it) {
+        if (!it->swapped && it->candidate && it->candidate->state() == QProcess::Running)
+            roots.insert(candidate_key(it.key()), it->candidate->processId());
+    }
+
+    mProcessTree.update(roots);
+    mLastScan.start();
 }
 
-void GracefulModule::terminate()
+void GracefulModuleManager::setLagProbe(bool enabled)
 {
-    mIsTerminating = true;
-    QProcess::terminate();
+    if (enabled == mLagTimer.isActive())
+        return;
+
+    if (enabled) {
+        mLagClock.start();
+        mLagTimer.start();
+    } else {
+        mLagTimer.stop();
+    }
+}
+
+void GracefulModuleManager::measureLag()
+{
+    Metrics::eventLoopLag.observe(qMax<qint64>(0, mLagClock.nsecsElapsed() / 1000 - qint64(mLagTimer.interval()) * 1000));
+    mLagClock.restart();
+}
+
+void GracefulModuleManager::signalModuleTree(const QString& name, int sig, bool scan)
+{
+    if (scan && (!mLastScan.isValid() || mLastScan.elapsed() >= PROCESS_SCAN_FRESH_MS))
+        scanProcesses();
+
+    // at logout: the module leads its own process group (see
+    // setupChildProcess), its descendants which left the group are known
+    // from the process tree
+    GracefulModule* p = mNameMap.value(name);
+    if (p && p->processId() > 0)
+        ::kill(-static_cast<pid_t>(p->processId()), sig);
+    else if (mAdopted.contains(name))
+        ::kill(-static_cast<pid_t>(mAdopted.value(name).pid), sig);
+
+    const QList<qint64> members = mProcessTree.members(name);
+    for (qint64 pid : members)
+        ::kill(static_cast<pid_t>(pid), sig);
+}
+
+QList<qint64> GracefulModuleManager::moduleGroup(const QString& name, qint64 leader)
+{
+    if (leader <= 0)
+        return QList<qint64>();
+
+    if (!mLastScan.isValid() || mLastScan.elapsed() >= PROCESS_SCAN_FRESH_MS)
+        scanProcesses();
+
+    QList<qint64> group{leader};
+    const QList<qint64> members = mProcessTree.members(name);
+    for (qint64 pid : members) {
+        if (pid != leader && ::getpgid(static_cast<pid_t>(pid)) == static_cast<pid_t>(leader))
+            group << pid;
+    }
+    return group;
+}
+
+void GracefulModuleManager::setMemoryBudgets(const QHash<QString, qint64>& budgets, bool restart)
+{
+    mMemoryBudgets = budgets;
+    mMemoryRestart = restart;
+}
+
+void GracefulModuleManager::setUserIdle(bool idle)
+{
+    mUserIdle = idle;
+    if (mUserIdle)
+        sampleMemory();
+}
+
+void GracefulModuleManager::sampleMemory()
+{
+    scanProcesses();
+
+    for (auto it = mNameMap.constBegin(); it != mNameMap.constEnd(); ++it) {
+        GracefulModule* p = it.value();
+        if (!p || p->state() != QProcess::Running)
+            continue;
+        if (!sampleModule(it.key(), p->processId(), p->memoryBudget()) || p->isRestarting())
+            continue;
+
+        log_info("restarting module %s", it.key().toUtf8().constData());
+        // the module process only, applications it started stay up
+        p->restart();
+        QPointer<GracefulModule> guard(p);
+        QTimer::singleShot(MEMORY_RESTART_KILL_MS, this, [guard] {
+            if (guard && guard->isRestarting() && guard->state() != QProcess::NotRunning)
+                guard->kill();
+        });
+    }
+
+    const QStringList adopted = mAdopted.keys();
+    for (const QString& name : adopted) {
+        const AdoptedModule& m = mAdopted[name];
+        if (!sampleModule(name, m.pid, memory_budget(m.file)) || m.restarting)
+            continue;
+
+        log_info("restarting module %s", name.toUtf8().constData());
+        restartAdopted(name, MEMORY_RESTART_KILL_MS);
+    }
+}
+
+bool GracefulModuleManager::sampleModule(const QString& name, qint64 leader, qint64 fileBudget)
+{
+    const bool leaked = mMemoryMonitor.leaking(name);
+    // the applications a launcher started are not the module's memory
+    mMemoryMonitor.sample(name, moduleGroup(name, leader));
+    if (!leaked && mMemoryMonitor.leaking(name))
+        log_warn("module %s looks like it leaks memory: %lld kB/h", name.toUtf8().constData(), mMemoryMonitor.slope(name));
+
+    const qint64 budget = fileBudget > 0 ? fileBudget : mMemoryBudgets.value(name);
+    const qint64 used = mMemoryMonitor.current(name);
+    if (budget <= 0 || used <= budget)
+        return false;
+
+    log_warn("module %s uses %lld kB, its budget is %lld kB", name.toUtf8().constData(), used, budget);
+    // only while the user is away, nobody should see the bar vanish
+    return mMemoryRestart && mUserIdle;
+}
+
+QStringList GracefulModuleManager::memoryUsage() const
+{
+    return mMemoryMonitor.report();
+}
+
+QStringList GracefulModuleManager::moduleResources()
+{
+    scanProcesses();
+
+    QStringList ret;
+    QStringList names = mProcessTree.modules();
+    names.sort();
+    for (const QString& name : qAsConst(names)) {
+        const ProcessTree::Usage usage = mProcessTree.usage(name);
+        ret << QSL("%1 %2 %3 %4").arg(name).arg(usage.processes).arg(usage.cpuMs).arg(usage.rssKb);
+    }
+
+    return ret;
+}
+
+qint64 GracefulModuleManager::spawn(const QString& program, const QStringList& args,
+                                   const QMap<QByteArray, QByteArray>& env, const QString& cwd)
+{
+    const qint64 pid = spawnDetached(program, args, env, cwd);
+    if (pid < 0)
+        return -1;
+
+    // forget the applications which are gone meanwhile
+    for (auto it = mLaunchedApps.begin(); it != mLaunchedApps.end();) {
+        if (::kill(static_cast<pid_t>(it->pid), 0) != 0 && errno == ESRCH)
+            it = mLaunchedApps.erase(it);
+        else
+            ++it;
+    }
+    mLaunchedApps << LaunchedApp{pid, program, args};
+    return pid;
+}
+
+qint64 GracefulModuleManager::spawnDetached(const QString& program, const QStringList& args,
+                                           const QMap<QByteArray, QByteArray>& env, const QString& cwd)
+{
+    QList<QByteArray> argBytes;
+    argBytes << QFile::encodeName(program);
+    for (const QString& arg : args)
+        argBytes << arg.toLocal8Bit();
+
+    QVector<char*> argv;
+    for (QByteArray& arg : argBytes)
+        argv << arg.data();
+    argv << nullptr;
+
+    QList<QByteArray> envBytes;
+    QVector<char*> envp;
+    if (!env.isEmpty()) {
+        for (char** e = environ; *e; ++e) {
+            const char* eq = strchr(*e, '=');
+            if (!eq || !env.contains(QByteArray(*e, eq - *e)))
+                envp << *e;
+        }
+        for (auto it = env.constBegin(); it != env.constEnd(); ++it)
+            envBytes << it.key() + '=' + it.value();
+        for (QByteArray& e : envBytes)
+            envp << e.data();
+        envp << nullptr;
+    }
+
+    // posix_spawn avoids copying the page tables of the session, the
+    // ProcReaper thread collects the child once it exits
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    const QByteArray cwdBytes = QFile::encodeName(cwd);
+    if (!cwd.isEmpty())
+        posix_spawn_file_actions_addchdir_np(&actions, cwdBytes.constData());
+
+    pid_t pid = -1;
+    const int ret = posix_spawn(&pid, argv.first(), &actions, &attr, argv.data(), env.isEmpty() ? environ : envp.data());
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (ret != 0) {
+        log_error("unable to start %s: %s", argv.first(), strerror(ret));
+        return -1;
+    }
+
+    mProcReaper.expect(pid);
+    ++Metrics::spawns;
+    return pid;
+}
+
+void GracefulModuleManager::setSessionFile(const QString& path)
+{
+    mSessionFile = path;
+}
+
+/**
+* @brief environment entries of pid which differ from the session's own
+**/
+static QJsonObject environment_delta(qint64 pid, const QProcessEnvironment& own)
+{
+    QJsonObject delta;
+    QFile file(QSL("/proc/%1/environ").arg(pid));
+    if (!file.open(QIODevice::ReadOnly))
+        return delta;
+
+    const QList<QByteArray> entries = file.readAll().split('\0');
+    for (const QByteArray& entry : entries) {
+        const int eq = entry.indexOf('=');
+        if (eq <= 0)
+            continue;
+        const QString key = QString::fromLocal8Bit(entry.left(eq));
+        const QString value = QString::fromLocal8Bit(entry.mid(eq + 1));
+        if (own.value(key) != value || !own.contains(key))
+            delta[key] = value;
+    }
+
+    return delta;
+}
+
+/**
+* @brief arguments of pid, the program name included
+**/
+static QStringList command_line(qint64 pid)
+{
+    QFile file(QSL("/proc/%1/cmdline").arg(pid));
+    if (!file.open(QIODevice::ReadOnly))
+        return QStringList();
+
+    QStringList ret;
+    const QList<QByteArray> args = file.readAll().split('\0');
+    for (const QByteArray& arg : args)
+        ret << QString::fromLocal8Bit(arg);
+    // the list ends with a NUL
+    if (!ret.isEmpty() && ret.last().isEmpty())
+        ret.removeLast();
+    return ret;
+}
+
+/**
+* @brief parent of pid, -1 if it is gone
+**/
+static qint64 parent_pid(qint64 pid)
+{
+    QFile file(QSL("/proc/%1/stat").arg(pid));
+    if (!file.open(QIODevice::ReadOnly))
+        return -1;
+
+    // "pid (comm) state ppid ...", comm may contain anything
+    const QByteArray stat = file.readAll();
+    const QList<QByteArray> fields = stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+    return fields.size() > 1 ? fields.at(1).toLongLong() : -1;
+}
+
+/**
+* @brief program, arguments, working directory and environment of a running application
+**/
+static QJsonObject application_entry(qint64 pid, const QString& program, const QStringList& args, const QProcessEnvironment& own)
+{
+    QJsonObject entry;
+    entry[QSL("program")] = program;
+    entry[QSL("args")] = QJsonArray::fromStringList(args);
+    entry[QSL("cwd")] = QFile::symLinkTarget(QSL("/proc/%1/cwd").arg(pid));
+    entry[QSL("env")] = environment_delta(pid, own);
+    return entry;
+}
+
+void GracefulModuleManager::saveSession()
+{
+    if (mSessionFile.isEmpty())
+        return;
+
+    QJsonArray modules;
+    for (const QString& name : qAsConst(mStartOrder)) {
+        const GracefulModule* p = mNameMap.value(name);
+        // the built-in modules have no desktop file and start anyway
+        if (!p || p->state() == QProcess::NotRunning || p->file.fileName().isEmpty() || !QFile::exists(p->file.fileName()))
+            continue;
+        modules << QJsonObject{{QSL("name"), name}, {QSL("file"), p->file.fileName()}};
+    }
+
+    const QProcessEnvironment own = QProcessEnvironment::systemEnvironment();
+    QJsonArray apps;
+    QSet<qint64> saved;
+    for (const LaunchedApp& app : qAsConst(mLaunchedApps)) {
+        // the pid may have been reused, it must still run the same program
+        const QString exe = QFile::symLinkTarget(QSL("/proc/%1/exe").arg(app.pid));
+        if (exe.isEmpty() || QFileInfo(exe).canonicalFilePath() != QFileInfo(app.program).canonicalFilePath())
+            continue;
+
+        apps << application_entry(app.pid, app.program, app.args, own);
+        saved << app.pid;
+    }
+
+    // applications the launcher modules (dock, bar, desktop) started run in
+    // their own session; what they start themselves comes back with them.
+    // The process tree was scanned by the caller.
+    const pid_t moduleSession = ::getsid(0);
+    const QStringList trees = mProcessTree.modules();
+    for (const QString& name : trees) {
+        const QList<qint64> members = mProcessTree.members(name);
+        for (qint64 pid : members) {
+            if (saved.contains(pid) || ::getsid(static_cast<pid_t>(pid)) != static_cast<pid_t>(pid))
+                continue;
+            const qint64 parent = parent_pid(pid);
+            if (members.contains(parent) && ::getsid(static_cast<pid_t>(parent)) != moduleSession)
+                continue;
+
+            QStringList args = command_line(pid);
+            const QString exe = QFile::symLinkTarget(QSL("/proc/%1/exe").arg(pid));
+            if (args.isEmpty() || exe.isEmpty())
+                continue;
+            args.removeFirst();
+            apps << application_entry(pid, exe, args, own);
+            saved << pid;
+        }
+    }
+
+    QJsonObject root;
+    root[QSL("version")] = SESSION_FILE_VERSION;
+    root[QSL("modules")] = modules;
+    root[QSL("apps")] = apps;
+
+    QDir().mkpath(QFileInfo(mSessionFile).absolutePath());
+    QSaveFile file(mSessionFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        log_error("unable to write %s", mSessionFile.toUtf8().constData());
+        return;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    if (!file.commit())
+        log_error("unable to write %s", mSessionFile.toUtf8().constData());
+    else
+        log_debug("session saved: %d modules, %d applications", modules.size(), apps.size());
+}
+
+void GracefulModuleManager::restoreSession()
+{
+    QFile file(mSessionFile);
+    if (mSessionFile.isEmpty() || !file.open(QIODevice::ReadOnly))
+        return;
+
+    const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    // a snapshot is restored once, the next logout writes a new one
+    file.remove();
+    if (root.value(QSL("version")).toInt() != SESSION_FILE_VERSION)
+        return;
+
+    // in the saved start order, whatever the autostart brought up is skipped
+    const QJsonArray modules = root.value(QSL("modules")).toArray();
+    for (const QJsonValue& value : modules) {
+        const QJsonObject entry = value.toObject();
+        const QString name = entry.value(QSL("name")).toString();
+        if (mNameMap.contains(name))
+            continue;
+
+        bool paced = false;
+        for (const PendingStart& p : qAsConst(mPacedStarts))
+            paced |= p.name == name;
+        if (paced)
+            continue;
+
+        XdgDesktopFile desktop;
+        if (desktop.load(entry.value(QSL("file")).toString())) {
+            schedule(name, [this, name, desktop] {
+                if (!mNameMap.contains(name))
+                    startProcess(desktop);
+            });
+        }
+    }
+
+    // spawn() does not wait for the child, the applications start in parallel
+    const QJsonArray apps = root.value(QSL("apps")).toArray();
+    for (const QJsonValue& value : apps) {
+        const QJsonObject entry = value.toObject();
+        const QString program = entry.value(QSL("program")).toString();
+        if (!QFileInfo(program).isExecutable())
+            continue;
+
+        QStringList args;
+        for (const QJsonValue& arg : entry.value(QSL("args")).toArray())
+            args << arg.toString();
+
+        QMap<QByteArray, QByteArray> env;
+        const QJsonObject delta = entry.value(QSL("env")).toObject();
+        for (auto it = delta.constBegin(); it != delta.constEnd(); ++it)
+            env[it.key().toLocal8Bit()] = it.value().toString().toLocal8Bit();
+
+        QString cwd = entry.value(QSL("cwd")).toString();
+        if (!QFileInfo(cwd).isDir())
+            cwd.clear();
+
+        schedule(QFileInfo(program).fileName(), [this, program, args, env, cwd] {
+            spawn(program, args, env, cwd);
+        });
+    }
+
+    runSchedule();
+    log_debug("session restored: %d modules, %d applications", modules.size(), apps.size());
+}
+
+/**
+* @brief pidfd of pid, -1 with errno set if the kernel has none
+**/
+static int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+#else
+    Q_UNUSED(pid);
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+QJsonObject GracefulModuleManager::saveState()
+{
+    abortUpgrades();
+
+    // the next image knows nothing about throttles, a frozen module
+    // would never be continued
+    for (auto it = mNameMap.constBegin(); it != mNameMap.constEnd(); ++it) {
+        GracefulModule* p = it.value();
+        if (p && p->state() == QProcess::Running)
+            p->setThrottle(GracefulModule::NoThrottle, moduleGroup(it.key(), p->processId()));
+    }
+    for (auto it = mAdopted.begin(); it != mAdopted.end(); ++it) {
+        apply_throttle(it.key(), static_cast<pid_t>(it->pid), it->throttle, it->throttled,
+                       GracefulModule::NoThrottle, moduleGroup(it.key(), it->pid));
+    }
+
+    auto module_state = [this] (const QString& name, const XdgDesktopFile& file, qint64 pid, const ModuleCrashReport& crashes) {
+        QJsonArray output;
+        for (int fd : mModuleOutput.handOver(name))
+            output << fd;
+        QJsonArray crashReport;
+        for (time_t t : crashes)
+            crashReport << static_cast<qint64>(t);
+        return QJsonObject{
+            {QSL("name"), name},
+            {QSL("file"), file.fileName()},
+            {QSL("title"), file.name()},
+            {QSL("exec"), file.value(QSL("Exec")).toString()},
+            {QSL("pid"), pid},
+            {QSL("output"), output},
+            {QSL("crashes"), crashReport}};
+    };
+
+    QJsonArray modules;
+    for (auto it = mNameMap.constBegin(); it != mNameMap.constEnd(); ++it) {
+        const GracefulModule* p = it.value();
+        if (p && p->state() == QProcess::Running)
+            modules << module_state(it.key(), p->file, p->processId(), p->crashReport);
+    }
+    for (auto it = mAdopted.constBegin(); it != mAdopted.constEnd(); ++it)
+        modules << module_state(it.key(), it->file, it->pid, it->crashReport);
+
+    QJsonArray apps;
+    for (const LaunchedApp& app : qAsConst(mLaunchedApps)) {
+        apps << QJsonObject{
+            {QSL("pid"), app.pid},
+            {QSL("program"), app.program},
+            {QSL("args"), QJsonArray::fromStringList(app.args)}};
+    }
+
+    QJsonObject state;
+    state[QSL("version")] = SESSION_FILE_VERSION;
+    state[QSL("modules")] = modules;
+    state[QSL("apps")] = apps;
+    state[QSL("order")] = QJsonArray::fromStringList(mStartOrder);
+    return state;
+}
+
+void GracefulModuleManager::adoptState(const QJsonObject& state)
+{
+    // a fresh image, not one whose exec failed
+    mReexecuted = mNameMap.isEmpty();
+
+    for (const QJsonValue& value : state.value(QSL("modules")).toArray()) {
+        const QJsonObject entry = value.toObject();
+        const QString name = entry.value(QSL("name")).toString();
+        const qint64 pid = entry.value(QSL("pid")).toVariant().toLongLong();
+        if (name.isEmpty() || pid <= 0)
+            continue;
+
+        for (const QJsonValue& fd : entry.value(QSL("output")).toArray())
+            mModuleOutput.adopt(name, fd.toInt(-1));
+        // an exec which failed hands the state back to the same image
+        if (mNameMap.contains(name) || mAdopted.contains(name))
+            continue;
+
+        AdoptedModule m;
+        const QString fileName = entry.value(QSL("file")).toString();
+        if (fileName.isEmpty() || !m.file.load(fileName)) {
+            // built-in modules have no desktop file
+            m.file = XdgDesktopFile(XdgDesktopFile::ApplicationType, entry.value(QSL("title")).toString(), entry.value(QSL("exec")).toString());
+            m.file.setValue(QL1S("X-Graceful-Module"), true);
+        }
+        m.pid = pid;
+        m.terminating = false;
+        m.restarting = false;
+        m.throttle = GracefulModule::NoThrottle;
+        m.notifier = nullptr;
+        for (const QJsonValue& t : entry.value(QSL("crashes")).toArray())
+            m.crashReport << static_cast<time_t>(t.toVariant().toLongLong());
+
+        // the pid stayed the same across exec, so the modules are still our
+        // children; a pidfd tells when one of them is gone
+        mProcReaper.watch(static_cast<pid_t>(pid));
+        m.pidFd = open_pidfd(static_cast<pid_t>(pid));
+        if (m.pidFd >= 0) {
+            ::fcntl(m.pidFd, F_SETFD, FD_CLOEXEC);
+            m.notifier = new QSocketNotifier(m.pidFd, QSocketNotifier::Read, this);
+            connect(m.notifier, &QSocketNotifier::activated, this, [this, name] { adoptedExited(name); });
+        } else if (errno == ESRCH) {
+            // ended during the exec
+            mAdopted.insert(name, m);
+            QTimer::singleShot(0, this, [this, name] { adoptedExited(name); });
+            continue;
+        } else {
+            log_warn("no pidfd for module %s (%s), it is restarted only at the next login", name.toUtf8().constData(), strerror(errno));
+        }
+        mAdopted.insert(name, m);
+        watchBinary(module_executable(m.file));
+    }
+
+    for (const QJsonValue& value : state.value(QSL("apps")).toArray()) {
+        const QJsonObject entry = value.toObject();
+        const qint64 pid = entry.value(QSL("pid")).toVariant().toLongLong();
+        if (std::any_of(mLaunchedApps.cbegin(), mLaunchedApps.cend(), [pid] (const LaunchedApp& app) { return app.pid == pid; }))
+            continue;
+        QStringList args;
+        for (const QJsonValue& arg : entry.value(QSL("args")).toArray())
+            args << arg.toString();
+        mLaunchedApps << LaunchedApp{pid, entry.value(QSL("program")).toString(), args};
+    }
+
+    for (const QJsonValue& name : state.value(QSL("order")).toArray()) {
+        if (!mStartOrder.contains(name.toString()))
+            mStartOrder << name.toString();
+    }
+
+    log_info("adopted %d modules from the previous session image", mAdopted.size());
+}
+
+void GracefulModuleManager::adoptedExited(const QString& name)
+{
+    if (!mAdopted.contains(name))
+        return;
+
+    AdoptedModule m = mAdopted.take(name);
+    delete m.notifier;
+    if (m.pidFd >= 0)
+        ::close(m.pidFd);
+
+    // the reaper thread keeps the status of adopted modules for us
+    int status = 0;
+    const pid_t ret = mProcReaper.reap(static_cast<pid_t>(m.pid), status);
+    if (m.terminating)
+        return;
+
+    if (m.restarting) {
+        signal_group(m.pid, SIGTERM);
+        startProcess(m.file);
+        if (GracefulModule* p = mNameMap.value(name))
+            p->crashReport = m.crashReport;
+        return;
+    }
+
+    if (ret == m.pid && WIFEXITED(status)) {
+        log_debug("Process %s exited correctly.", m.file.name().toUtf8().constData());
+        return;
+    }
+
+    ++Metrics::crashes;
+    const time_t now = time(nullptr);
+    m.crashReport.prepend(now);
+    while (now - m.crashReport.back() > 60)
+        m.crashReport.pop_back();
+    if (m.crashReport.length() >= MAX_CRASHES_PER_APP) {
+        mErrorNotifier->report(ErrorNotifier::Warning, tr("Crash Report"), tr("<b>%1</b> crashed too many times. Its autorestart has been disabled until next login.").arg(m.file.name()));
+        return;
+    }
+
+    // leftovers of the crashed instance would clash with the new one
+    signal_group(m.pid, SIGTERM);
+    ++Metrics::restarts;
+    startProcess(m.file);
+    if (GracefulModule* p = mNameMap.value(name))
+        p->crashReport = m.crashReport;
+}
+
+void GracefulModuleManager::restartAdopted(const QString& name, int killTimeout)
+{
+    AdoptedModule& m = mAdopted[name];
+    m.restarting = true;
+    // a stopped process would never see the SIGTERM
+    apply_throttle(name, static_cast<pid_t>(m.pid), m.throttle, m.throttled, GracefulModule::NoThrottle, moduleGroup(name, m.pid));
+    ::kill(static_cast<pid_t>(m.pid), SIGTERM);
+
+    const qint64 pid = m.pid;
+    QTimer::singleShot(killTimeout, this, [this, name, pid] {
+        if (mAdopted.contains(name) && mAdopted.value(name).pid == pid)
+            ::kill(static_cast<pid_t>(pid), SIGKILL);
+    });
+}
+
+void GracefulModuleManager::setBackgroundModules(const QStringList& names)
+{
+    mBackgroundModules = names;
+}
+
+GracefulModule::Throttle GracefulModuleManager::backgroundThrottle(const QString& name, const XdgDesktopFile& file) const
+{
+    if (!is_background(file) && !mBackgroundModules.contains(name))
+        return GracefulModule::NoThrottle;
+
+    // the stronger of the idle and the battery throttle wins
+    return qMax(mBackgroundThrottle, mOnBattery ? mBatteryThrottle : GracefulModule::NoThrottle);
+}
+
+void GracefulModuleManager::throttleBackgroundModules(GracefulModule::Throttle throttle)
+{
+    mBackgroundThrottle = throttle;
+    for (auto it = mNameMap.constBegin(); it != mNameMap.constEnd(); ++it) {
+        GracefulModule* p = it.value();
+        if (p->isBackground() || mBackgroundModules.contains(it.key()))
+            p->setThrottle(backgroundThrottle(it.key(), p->file), moduleGroup(it.key(), p->processId()));
+    }
+    for (auto it = mUpgrades.constBegin(); it != mUpgrades.constEnd(); ++it) {
+        GracefulModule* p = it->candidate;
+        if (!it->swapped && p && (p->isBackground() || mBackgroundModules.contains(it.key())))
+            p->setThrottle(backgroundThrottle(it.key(), p->file), moduleGroup(candidate_key(it.key()), p->processId()));
+    }
+    for (auto it = mAdopted.begin(); it != mAdopted.end(); ++it) {
+        if (is_background(it->file) || mBackgroundModules.contains(it.key())) {
+            apply_throttle(it.key(), static_cast<pid_t>(it->pid), it->throttle, it->throttled,
+                           backgroundThrottle(it.key(), it->file), moduleGroup(it.key(), it->pid));
+        }
+    }
+}
+
+void GracefulModuleManager::setOnBattery(bool onBattery, GracefulModule::Throttle throttle, int intervalScale)
+{
+    mOnBattery = onBattery;
+    mBatteryThrottle = throttle;
+
+    const int scale = mOnBattery ? qMax(1, intervalScale) : 1;
+    mProcessScanTimer.setInterval(PROCESS_SCAN_INTERVAL_MS * scale);
+    mMemoryTimer.setInterval(MEMORY_SAMPLE_INTERVAL_MS * scale);
+    // setInterval() restarts an active timer, the clock goes with it
+    mLagTimer.setInterval(LAG_PROBE_INTERVAL_MS * scale);
+    if (mLagTimer.isActive())
+        mLagClock.restart();
+
+    throttleBackgroundModules(mBackgroundThrottle);
+
+    // deferred while on battery, the timer is only running during login
+    if (!mOnBattery && !mIdlePhaseApps.isEmpty() && !mIdlePhaseTimer.isActive())
+        startIdlePhaseApps();
+}
+
+void GracefulModuleManager::setSleepModules(const QStringList& names, int thawStagger)
+{
+    mSleepModules = names;
+    mThawTimer.setInterval(thawStagger);
+}
+
+bool GracefulModuleManager::hasSleepModules() const
+{
+    if (!mSleepModules.isEmpty())
+        return true;
+
+    for (const GracefulModule* p : qAsConst(mNameMap)) {
+        if (p->freezeOnSleep())
+            return true;
+    }
+    for (const AdoptedModule& m : qAsConst(mAdopted)) {
+        if (freezes_on_sleep(m.file))
+            return true;
+    }
+    return false;
+}
+
+void GracefulModuleManager::freezeForSleep()
+{
+    mThawTimer.stop();
+    mThawQueue.clear();
+
+    QList<QPair<int, QString>> frozen;
+    for (auto it = mNameMap.constBegin(); it != mNameMap.constEnd(); ++it) {
+        GracefulModule* p = it.value();
+        if (p->freezeOnSleep() || mSleepModules.contains(it.key())) {
+            p->setThrottle(GracefulModule::Frozen);
+            // a new version in its overlap is frozen and thawed with it
+            const Upgrade upgrade = mUpgrades.value(it.key());
+            if (!upgrade.swapped && upgrade.candidate)
+                upgrade.candidate->setThrottle(GracefulModule::Frozen);
+            frozen << qMakePair(p->thawPriority(), it.key());
+        }
+    }
+    for (auto it = mAdopted.begin(); it != mAdopted.end(); ++it) {
+        if (freezes_on_sleep(it->file) || mSleepModules.contains(it.key())) {
+            apply_throttle(it.key(), static_cast<pid_t>(it->pid), it->throttle, it->throttled, GracefulModule::Frozen, QList<qint64>());
+            frozen << qMakePair(thaw_priority(it->file), it.key());
+        }
+    }
+
+    // thawed lowest priority value first
+    std::stable_sort(frozen.begin(), frozen.end(), [](const QPair<int, QString>& a, const QPair<int, QString>& b) {
+        return a.first < b.first;
+    });
+    for (const auto& module : qAsConst(frozen))
+        mThawQueue << module.second;
+
+    log_debug("%d modules frozen for sleep", mThawQueue.size());
+}
+
+void GracefulModuleManager::thawAfterSleep()
+{
+    // the first one right away, the locker gets the CPU between the others
+    thawNext();
+    if (!mThawQueue.isEmpty())
+        mThawTimer.start();
+}
+
+void GracefulModuleManager::thawNext()
+{
+    while (!mThawQueue.isEmpty()) {
+        const QString name = mThawQueue.takeFirst();
+        GracefulModule* p = mNameMap.value(name);
+        const auto adopted = mAdopted.find(name);
+        if (!p && adopted == mAdopted.end())
+            continue;
+
+        // idle and battery throttling may still apply to background modules
+        const GracefulModule::Throttle throttle = backgroundThrottle(name, p ? p->file : adopted->file);
+        if (p) {
+            p->setThrottle(throttle);
+            const Upgrade upgrade = mUpgrades.value(name);
+            if (!upgrade.swapped && upgrade.candidate)
+                upgrade.candidate->setThrottle(throttle);
+        } else {
+            apply_throttle(name, static_cast<pid_t>(adopted->pid), adopted->throttle, adopted->throttled, throttle, QList<qint64>());
+        }
+        break;
+    }
+
+    if (mThawQueue.isEmpty())
+        mThawTimer.stop();
+}
+
+QStringList GracefulModuleManager::listModules() const
+{
+    return QStringList(mNameMap.keys()) + mAdopted.keys();
+}
+
+QStringList GracefulModuleManager::moduleOutput(const QString& name, int lines) const
+{
+    return mModuleOutput.lastLines(name, lines);
+}
+
+void GracefulModuleManager::startConfUpdate()
+{
+    XdgDesktopFile desktop(XdgDesktopFile::ApplicationType, QSL(":graceful-confupdate"), QSL("graceful-confupdate --watch"));
+    desktop.setValue(QSL("Name"), QSL("Graceful config updater"));
+    desktop.setValue(QL1S("X-Graceful-Module"), true);
+    startProcess(desktop);
+}
+
+void GracefulModuleManager::restartModules(int /*exitCode*/, QProcess::ExitStatus exitStatus)
+{
+    GracefulModule* proc = qobject_cast<GracefulModule*>(sender());
+    if (nullptr == proc) {
+        log_warn("Got an invalid (null) module to restart. Ignoring it");
+        return;
+    }
+
+    // QProcess collected it, unless the reaper thread was faster
+    mProcReaper.forget(static_cast<pid_t>(proc->processGroup()));
+
+    if (handleUpgradeExit(proc))
+        return;
+
+    if (proc->isRestarting()) {
+        // asked for, e.g. over its memory budget: no crash report entry
+        mMemoryMonitor.remove(proc->name());
+        ++Metrics::restarts;
+        proc->start();
+        return;
+    }
+
+    if (!proc->isTerminating()) {
+        QString procName = proc->file.name();
+        switch (exitStatus) {
+        case QProcess::NormalExit:
+            log_debug("Process %s exited correctly.", procName.toUtf8().constData());
+            break;
+        case QProcess::CrashExit: {
+            ++Metrics::crashes;
+            log_debug("Process %s has to be restarted", procName.toUtf8().constData());
+            time_t now = time(nullptr);
+            proc->crashReport.prepend(now);
+            while (now - proc->crashReport.back() > 60)
+                proc->crashReport.pop_back();
+            if (proc->crashReport.length() >= MAX_CRASHES_PER_APP) {
+                mErrorNotifier->report(ErrorNotifier::Warning, tr("Crash Report"), tr("<b>%1</b> crashed too many times. Its autorestart has been disabled until next login.").arg(procName));
+            } else {
+                // leftovers of the crashed instance would clash with the new one
+                signal_group(proc->processGroup(), SIGTERM);
+                ++Metrics::restarts;
+                proc->start();
+                return;
+            }
+            break;
+        }
+        }
+    }
+    // only remove the entry if it is still this module
+    if (mNameMap.value(proc->name()) == proc)
+        mNameMap.remove(proc->name());
+    proc->deleteLater();
+}
+
+
+GracefulModuleManager::~GracefulModuleManager()
+{
+    qApp->removeNativeEventFilter(this);
+
+    // We disconnect the finished signal before deleting the process. We do
+    // this to prevent a crash that results from a state change signal being
+    // emmited while deleting a crashing module.
+    // If the module is still connect restartModules will be called with a
+    // invalid sender.
+
+    ModulesMapIterator i(mNameMap);
+    while (i.hasNext()) {
+        i.next();
+
+        auto p = i.value();
+        disconnect(p);
+
+        delete p;
+        mNameMap[i.key()] = nullptr;
+    }
+}
+
+/**
+* @brief this logs us out by terminating our session
+**/
+void GracefulModuleManager::logout(bool doExit)
+{
+    MetricsScope scope(Metrics::logoutDuration);
+
+    // modules, the process tree is scanned once for all of them
+    scanProcesses();
+
+    // before anything is terminated
+    saveSession();
+
+    abortUpgrades();
+    for (auto it = mAdopted.begin(); it != mAdopted.end(); ++it) {
+        it->terminating = true;
+        apply_throttle(it.key(), static_cast<pid_t>(it->pid), it->throttle, it->throttled, GracefulModule::NoThrottle, QList<qint64>());
+        signalModuleTree(it.key(), SIGTERM, false);
+    }
+    ModulesMapIterator i(mNameMap);
+    while (i.hasNext()) {
+        i.next();
+        log_debug("Module logout %s", i.key().toUtf8().constData());
+        GracefulModule* p = i.value();
+        p->terminate();
+        signalModuleTree(i.key(), SIGTERM, false);
+    }
+
+    // one deadline for all, hanging modules must not add up
+    QElapsedTimer deadline;
+    deadline.start();
+    i.toFront();
+    while (i.hasNext()) {
+        i.next();
+        GracefulModule* p = i.value();
+        const int left = static_cast<int>(qMax<qint64>(0, LOGOUT_TIMEOUT_MS - deadline.elapsed()));
+        if (p->state() != QProcess::NotRunning && !p->waitForFinished(left)) {
+            log_debug("Module %s won't terminate ... killing.", qPrintable(i.key()));
+            p->kill();
+        }
+    }
+
+    // adopted modules are no children of QProcess, poll what is left of them
+    for (const AdoptedModule& m : qAsConst(mAdopted)) {
+        int status;
+        while (mProcReaper.reap(static_cast<pid_t>(m.pid), status) == 0 && deadline.elapsed() < LOGOUT_TIMEOUT_MS)
+            QThread::msleep(10);
+    }
+
+    scanProcesses();
+    i.toFront();
+    while (i.hasNext()) {
+        i.next();
+        signalModuleTree(i.key(), SIGKILL, false);
+    }
+    for (auto it = mAdopted.constBegin(); it != mAdopted.constEnd(); ++it)
+        signalModuleTree(it.key(), SIGKILL, false);
+
+    if (doExit) {
+        QCoreApplication::exit(0);
+    }
+}
+
+QString GracefulModuleManager::showWmSelectDialog()
+{
+    WindowManagerList availableWM = getWindowManagerList(true);
+    if (availableWM.count() == 1)
+        return availableWM.at(0).command;
+
+    // the dialog lives in a helper so the session does not load QtWidgets
+    QProcess ui;
+    ui.start(QSL("graceful-session-ui"), {QSL("--select-wm")});
+    if (!ui.waitForFinished(-1) || ui.exitCode() != 0)
+        return QString();
+
+    return QString::fromLocal8Bit(ui.readAllStandardOutput()).trimmed();
+}
+
+void GracefulModuleManager::resetCrashReport()
+{
+    for (GracefulModule* p : qAsConst(mNameMap))
+        p->crashReport.clear();
+}
+
+bool GracefulModuleManager::nativeEventFilter(const QByteArray & eventType, void * message, long * /*result*/)
+{
+    // only the startup waits on these, and only their announcements are worth a round trip
+    if (eventType != "xcb_generic_event_t" || !mWaitLoop) // We only want to handle XCB events
+        return false;
+
+    if (!mWmStarted && x11_window_manager_event(message)) {
+        // all window managers must set their name according to the spec
+        if (x11_window_manager_running()) {
+            log_debug("Window Manager started");
+            mWmStarted = true;
+            if (mWaitLoop->isRunning())
+                mWaitLoop->exit();
+        }
+    }
+
+    if (!mTrayStarted && x11_system_tray_event(message) && x11_system_tray_running())
+        trayStarted();
+
+    return false;
+}
+
+void GracefulModuleManager::trayStarted()
+{
+    log_debug("System Tray started");
+    mTrayStarted = true;
+    if (mWaitLoop && mWaitLoop->isRunning())
+        mWaitLoop->exit();
+
+    // window manager and system tray have started
+    qApp->removeNativeEventFilter(this);
+}
+
+GracefulModule::GracefulModule(const XdgDesktopFile& file, QObject* parent) :
+    QProcess(parent),
+    file(file),
+    fileName(QFileInfo(file.fileName()).fileName()),
+    mIsTerminating(false),
+    mIsRestarting(false),
+    mThrottle(NoThrottle),
+    mProcessGroup(0),
+    mProgramFd(-1),
+    mOutput(nullptr),
+    mOutputFd(-1)
+{
+    QProcess::setProcessChannelMode(QProcess::ForwardedChannels);
+    connect(this, &GracefulModule::stateChanged, this, &GracefulModule::updateState);
+}
+
+GracefulModule::~GracefulModule()
+{
+    if (mProgramFd >= 0)
+        ::close(mProgramFd);
+}
+
+void GracefulModule::setOutput(ModuleOutput* output, const QString& name)
+{
+    mOutput = output;
+    mName = name;
+    mOutputName = name;
+}
+
+void GracefulModule::setOutputName(const QString& outputName)
+{
+    mOutputName = outputName;
+}
+
+void GracefulModule::start()
+{
+    mIsTerminating = false;
+    mIsRestarting = false;
+    // a new process, the manager throttles it once it runs
+    mThrottle = NoThrottle;
+    mThrottled.clear();
+    if (mExecArgs.isEmpty())
+        mExecArgs = file.expandExecString();
+    if (mExecArgs.isEmpty())
+        return;
+    QStringList args = mExecArgs;
+    QString command = args.takeFirst();
+    if (!mProgram.isEmpty())
+        command = mProgram;
+
+    // every start gets a fresh pipe, the ring keeps the output of earlier runs
+    if (mOutput)
+        mOutputFd = mOutput->attach(mOutputName);
+    QProcess::start(command, args);
+    if (mOutputFd >= 0) {
+        ::close(mOutputFd);
+        mOutputFd = -1;
+    }
+}
+
+void GracefulModule::setupChildProcess()
+{
+    // runs in the child, right before exec; the own process group lets
+    // the manager signal the module with all its children at once
+    ::setpgid(0, 0);
+    if (mOutputFd >= 0) {
+        ::dup2(mOutputFd, STDOUT_FILENO);
+        ::dup2(mOutputFd, STDERR_FILENO);
+    }
+}
+
+void GracefulModule::terminate()
+{
+    mIsTerminating = true;
+    // a stopped process would never see the SIGTERM
+    setThrottle(NoThrottle);
+    QProcess::terminate();
+}
+
+void GracefulModule::restart()
+{
+    mIsRestarting = true;
+    setThrottle(NoThrottle);
+    QProcess::terminate();
+}
+
+bool GracefulModule::isRestarting() const
+{
+    return mIsRestarting;
+}
+
+qint64 GracefulModule::memoryBudget() const
+{
+    return memory_budget(file);
+}
+
+QString GracefulModule::name() const
+{
+    return mName;
+}
+
+void GracefulModule::setProgramFd(int fd)
+{
+    if (mProgramFd >= 0)
+        ::close(mProgramFd);
+    mProgramFd = fd;
+    // a path to the fd of the session, the child opens it through /proc on exec
+    mProgram = QSL("/proc/%1/fd/%2").arg(QCoreApplication::applicationPid()).arg(fd);
+}
+
+QString GracefulModule::executable() const
+{
+    const QStringList args = mExecArgs.isEmpty() ? file.expandExecString() : mExecArgs;
+    return args.isEmpty() ? QString() : QStandardPaths::findExecutable(args.first());
+}
+
+void GracefulModule::resetExecArgs()
+{
+    mExecArgs.clear();
+}
+
+bool GracefulModule::isBackground() const
+{
+    return is_background(file);
+}
+
+bool GracefulModule::isSingleInstance() const
+{
+    return file.value(QL1S("X-Graceful-Single-Instance"), false).toBool();
+}
+
+bool GracefulModule::freezeOnSleep() const
+{
+    return freezes_on_sleep(file);
+}
+
+int GracefulModule::thawPriority() const
+{
+    return thaw_priority(file);
+}
+
+bool GracefulModule::setThrottle(Throttle throttle, const QList<qint64>& group)
+{
+    if (state() != QProcess::Running)
+        return true;
+
+    return apply_throttle(fileName, static_cast<pid_t>(processId()), mThrottle, mThrottled, throttle, group);
 }
 
 bool GracefulModule::isTerminating()
@@ -512,8 +2092,18 @@ bool GracefulModule::isTerminating()
     return mIsTerminating;
 }
 
+qint64 GracefulModule::processGroup() const
+{
+    return mProcessGroup;
+}
+
 void GracefulModule::updateState(QProcess::ProcessState newState)
 {
+    if (newState == QProcess::Running)
+        mProcessGroup = processId();
+    // before the manager learns about the exit, restarts are timed from here
+    else if (newState == QProcess::NotRunning)
+        restartTimer.start();
     if (newState != QProcess::Starting)
         Q_EMIT moduleStateChanged(fileName, (newState == QProcess::Running));
 }
@@ -5,27 +5,112 @@
 #include <QProcess>
 #include <QList>
 #include <QMap>
+#include <QHash>
+#include <QSet>
 #include <QTimer>
 #include <XdgDesktopFile>
 #include <QEventLoop>
+#include <QElapsedTimer>
+#include <QJsonObject>
 #include <time.h>
+#include <functional>
 #include "proc-reaper.h"
+#include "module-output.h"
+#include "process-tree.h"
+#include "memory-monitor.h"
+#include "session-environment.h"
 
 class GracefulModule;
-namespace graceful {
-class Settings;
-}
+class SessionSettings;
+class ErrorNotifier;
+class StartupHistory;
 class QFileSystemWatcher;
+class QSocketNotifier;
 
 typedef QMap<QString,GracefulModule*>           ModulesMap;
 typedef QList<time_t>                           ModuleCrashReport;
-typedef QMap<QProcess*, ModuleCrashReport>      ModulesCrashReport;
 typedef QMapIterator<QString,GracefulModule*>   ModulesMapIterator;
 
 
-void graceful_setenv(const char *env, const QByteArray &value);
-void graceful_setenv_prepend(const char *env, const QByteArray &value, const QByteArray &separator=":");
+class GracefulModule : public QProcess
+{
+    Q_OBJECT
+public:
+    enum Throttle {
+        NoThrottle,
+        IdlePriority,   // SCHED_BATCH, no wakeup preference over interactive processes
+        Frozen          // SIGSTOP until the throttle is lifted
+    };
+
+    void start();
+    void terminate();
+    bool isTerminating();
+
+    GracefulModule(const XdgDesktopFile& file, QObject* parent = nullptr);
+    ~GracefulModule();
+
+    void setOutput(ModuleOutput* output, const QString& name);
+    // the ring the next start writes to, the name unless set
+    void setOutputName(const QString& outputName);
+    QString name() const;
+    // runs the file behind fd instead of the executable from Exec, used
+    // for rollbacks; the module owns fd
+    void setProgramFd(int fd);
+    // the executable from Exec, also while a rollback runs
+    QString executable() const;
+    // drops the expanded Exec, it depends on the environment
+    void resetExecArgs();
+
+    // restarts through the crash-restart path without counting as a crash
+    void restart();
+    bool isRestarting() const;
+    // the pid of the last run, which led the process group; still valid
+    // after the exit for the leftovers in the group
+    qint64 processGroup() const;
+    qint64 memoryBudget() const;
+
+    bool isBackground() const;
+    bool isSingleInstance() const;
+    bool freezeOnSleep() const;
+    int thawPriority() const;
+    // group: the other processes of the module's process group, they are
+    // rescheduled with it; false if the old throttle could not be lifted
+    bool setThrottle(Throttle throttle, const QList<qint64>& group = QList<qint64>());
 
+    const XdgDesktopFile    file;
+    const QString           fileName;
+    // runs from the exit of a module until it runs again
+    QElapsedTimer           restartTimer;
+    // crashes within the last minute, newest first
+    ModuleCrashReport       crashReport;
+
+Q_SIGNALS:
+    void moduleStateChanged(QString name, bool state);
+
+protected:
+    void setupChildProcess() override;
+
+private Q_SLOTS:
+    void updateState(QProcess::ProcessState newState);
+
+private:
+    bool                    mIsTerminating;
+    bool                    mIsRestarting;
+    Throttle                mThrottle;
+    qint64                  mProcessGroup;
+    // the processes moved to SCHED_BATCH, given back by the next throttle
+    QList<qint64>           mThrottled;
+
+    // Exec expanded once, restarts reuse it
+    QStringList             mExecArgs;
+    QString                 mProgram;
+    int                     mProgramFd;
+
+    ModuleOutput*           mOutput;
+    QString                 mName;
+    QString                 mOutputName;
+    int                     mOutputFd;
+};
 
 class GracefulModuleManager : public QObject, public QAbstractNativeEventFilter
 {
@@ -39,9 +124,64 @@ public:
     void stopProcess(const QString& name);
     void startProcess(const QString& name);
 
+    // launches a program outside of the module table, returns its pid or -1;
+    // env is applied on top of the session environment, cwd may be empty
+    qint64 spawn(const QString& program, const QStringList& args,
+                 const QMap<QByteArray, QByteArray>& env = QMap<QByteArray, QByteArray>(),
+                 const QString& cwd = QString());
+
+    // modules and spawned applications still running at logout are saved
+    // to the file and brought back by restoreSession()
+    void setSessionFile(const QString& path);
+    void restoreSession();
+
+    // module table for a re-executed session: the modules keep running and
+    // their output pipes stay open across exec, adoptState() takes them
+    // back in the new image until they exit and are started normally
+    QJsonObject saveState();
+    void adoptState(const QJsonObject& state);
+
+    // background modules are throttled while the user is idle
+    void setBackgroundModules(const QStringList& names);
+    void throttleBackgroundModules(GracefulModule::Throttle throttle);
+
+    // on battery the background modules get at least throttle, the
+    // sampling and lag probe intervals are scaled and idle phase
+    // autostarts wait for AC
+    void setOnBattery(bool onBattery, GracefulModule::Throttle throttle, int intervalScale);
+
+    // Exec lines are expanded again on the next start of every module
+    void environmentChanged();
+
+    // the event loop lag is only probed while the metrics are served
+    void setLagProbe(bool enabled);
+
+    // marked modules are stopped during suspend and continued one by one
+    void setSleepModules(const QStringList& names, int thawStagger);
+    bool hasSleepModules() const;
+    void freezeForSleep();
+    void thawAfterSleep();
+
+    // budgets in kB from [MemoryBudget], X-Graceful-Memory-Budget wins;
+    // with restart an over budget module is restarted once the user is idle
+    void setMemoryBudgets(const QHash<QString, qint64>& budgets, bool restart);
+    void setUserIdle(bool idle);
+    QStringList memoryUsage() const;
+
+    // one line per module: processes, CPU ms and RSS kB of its whole tree
+    QStringList moduleResources();
+
+    // a replaced module binary is started next to the running instance,
+    // which is retired after overlap ms; 0 disables the upgrade
+    void setUpgradeOverlap(int overlap);
+
+    // predicted and measured readiness of the modules of this login
+    QStringList startupTimings() const;
+
     QStringList listModules() const;
+    QStringList moduleOutput(const QString& name, int lines) const;
 
-    void startup(graceful::Settings& s);
+    void startup(const SessionSettings& s);
 
     bool nativeEventFilter(const QByteArray & eventType, void * message, long * result) override;
 
@@ -51,27 +191,72 @@ public Q_SLOTS:
 
 Q_SIGNALS:
     void moduleStateChanged(QString moduleName, bool state);
+    void themeUpdated(const QString& theme);
 
 private:
-    void startWm();
+    bool startWm();
     void startBar();
     void wmStarted();
+    void trayStarted();
     void startDocker();
     void startDaemon();
     void startDesktop();
     void startNetworkPlugin();
 
-    void startAutostartApps();
+    // tray apps are left out and returned, they wait for the tray
+    XdgDesktopFileList scheduleAutostartApps();
+    void startTrayApps(const XdgDesktopFileList& trayApps);
+    void startDetached(const XdgDesktopFile& file);
+
+    void schedule(const QString& name, const std::function<void()>& start);
+    void runSchedule();
 
     QString showWmSelectDialog();
 
     void startConfUpdate();
     void startProcess(const XdgDesktopFile &file);
+    GracefulModule* launchModule(const XdgDesktopFile &file, const QString &name, int programFd = -1,
+                                 const QString &outputName = QString());
+    void watchBinary(const QString& executable);
+    void restartForUpgrade(GracefulModule* old, int rollbackFd);
+    void armRollback(const QString& name);
+    bool handleUpgradeExit(GracefulModule* proc);
+    void abortUpgrades();
+    void adoptedExited(const QString& name);
+    // an adopted module has no QProcess to restart, it is stopped and
+    // started as a module once it is gone; killed after killTimeout ms
+    void restartAdopted(const QString& name, int killTimeout);
+
+    void saveSession();
+    // posix_spawn in a new session, the ProcReaper collects the child
+    qint64 spawnDetached(const QString& program, const QStringList& args,
+                         const QMap<QByteArray, QByteArray>& env, const QString& cwd);
+
+    // at logout: signals the process group and every tracked descendant
+    // of a module, the applications it started included
+    void signalModuleTree(const QString& name, int sig, bool scan = true);
+    // leader and the tracked processes still in its process group; what a
+    // launcher module started with setsid() belongs to the user, not to it
+    QList<qint64> moduleGroup(const QString& name, qint64 leader);
+    // the throttle a module gets from idle and battery, none if not background
+    GracefulModule::Throttle backgroundThrottle(const QString& name, const XdgDesktopFile& file) const;
+    // samples the memory of the module's group, true if it is over budget
+    // and should be restarted now
+    bool sampleModule(const QString& name, qint64 leader, qint64 fileBudget);
 
 private Q_SLOTS:
     void resetCrashReport();
-
-    void themeFolderChanged(const QString&);
+    void thawNext();
+    void startNextPaced();
+    void scanProcesses();
+    void sampleMemory();
+    void measureLag();
+    void startIdlePhaseApps();
+    void binaryChanged(const QString& path);
+    void startUpgrades();
+    void finishUpgrade(const QString& name);
+
+    void themeFolderChanged();
 
     void themeChanged();
 
@@ -80,13 +265,94 @@ private:
     bool                    mTrayStarted;
 
     ModulesMap              mNameMap;
-    ModulesCrashReport      mCrashReport;
 
     QFileSystemWatcher*     mThemeWatcher;
+    QTimer                  mThemeTimer;
+
+    ErrorNotifier*          mErrorNotifier;
     QString                 mCurrentThemePath;
 
+    QStringList             mBackgroundModules;
+    GracefulModule::Throttle mBackgroundThrottle;
+    GracefulModule::Throttle mBatteryThrottle;
+    bool                    mOnBattery;
+
+    // X-Graceful-Autostart-Phase=Idle entries, started once login settled
+    QList<XdgDesktopFile>   mIdlePhaseApps;
+    QTimer                  mIdlePhaseTimer;
+
+    struct LaunchedApp {
+        qint64                          pid;
+        QString                         program;
+        QStringList                     args;
+    };
+
+    struct PendingStart {
+        QString                 name;
+        std::function<void()>   start;
+    };
+
+    StartupHistory*         mStartupHistory;
+    QList<PendingStart>     mPendingStarts;
+    QList<PendingStart>     mPacedStarts;
+    QTimer                  mPaceTimer;
+
+    QString                 mSessionFile;
+    QStringList             mStartOrder;
+    QList<LaunchedApp>      mLaunchedApps;
+
+    QStringList             mSleepModules;
+    QStringList             mThawQueue;
+    QTimer                  mThawTimer;
+
     QEventLoop*             mWaitLoop;
     ProcReaper              mProcReaper;
+    ModuleOutput            mModuleOutput;
+    ProcessTree             mProcessTree;
+    QTimer                  mProcessScanTimer;
+    QElapsedTimer           mLastScan;
+
+    struct Upgrade {
+        GracefulModule*     old;
+        GracefulModule*     candidate;
+        // the replaced binary, kept open for a rollback
+        int                 rollbackFd;
+        bool                swapped;
+    };
+
+    QFileSystemWatcher*     mBinaryWatcher;
+    QTimer                  mUpgradeTimer;
+    QStringList             mChangedBinaries;
+    QHash<QString, Upgrade> mUpgrades;
+    // modules whose new instance exited cleanly during an upgrade overlap,
+    // guessed to hand over to a running instance; see handleUpgradeExit()
+    QSet<QString>           mSingleInstance;
+    int                     mUpgradeOverlap;
+
+    // modules started by the session image before the last re-exec
+    struct AdoptedModule {
+        XdgDesktopFile      file;
+        qint64              pid;
+        int                 pidFd;
+        QSocketNotifier*    notifier;
+        ModuleCrashReport   crashReport;
+        bool                terminating;
+        bool                restarting;
+        GracefulModule::Throttle throttle;
+        QList<qint64>       throttled;
+    };
+
+    QHash<QString, AdoptedModule> mAdopted;
+    bool                    mReexecuted;
+
+    QTimer                  mLagTimer;
+    QElapsedTimer           mLagClock;
+
+    MemoryMonitor           mMemoryMonitor;
+    QTimer                  mMemoryTimer;
+    QHash<QString, qint64>  mMemoryBudgets;
+    bool                    mMemoryRestart;
+    bool                    mUserIdle;
 
     QString                 mBar;
     QString                 mDocker;
@@ -96,28 +362,4 @@ private:
     QString                 mNetworkPlugin;
 };
 
-class GracefulModule : public QProcess
-{
-    Q_OBJECT
-public:
-    void start();
-    void terminate();
-    bool isTerminating();
-
-    GracefulModule(const XdgDesktopFile& file, QObject* parent = nullptr);
-
-    const XdgDesktopFile    file;
-    const QString           fileName;
-
-Q_SIGNALS:
-    void moduleStateChanged(QString name, bool state);
-
-private Q_SLOTS:
-    void updateState(QProcess::ProcessState newState);
-
-private:
-    bool                    mIsTerminating;
-};
-
-
 #endif // GRACEFULMODMAN_H
@@ -0,0 +1,158 @@
+#include "idle-watcher.h"
+
+#include <graceful/log.h>
+
+#include <QCoreApplication>
+#include <QX11Info>
+
+#include <xcb/xcb.h>
+#include <xcb/sync.h>
+#include <cstdlib>
+#include <cstring>
+
+IdleWatcher::IdleWatcher(QObject *parent) :
+    QObject(parent),
+    mCounter(XCB_NONE),
+    mFirstEvent(0),
+    mIdleAlarm(XCB_NONE),
+    mResetAlarm(XCB_NONE),
+    mThreshold(0),
+    mIdle(false)
+{
+}
+
+IdleWatcher::~IdleWatcher()
+{
+    setThreshold(0);
+}
+
+bool IdleWatcher::init()
+{
+    if (mCounter != XCB_NONE)
+        return true;
+
+    if (!QX11Info::isPlatformX11())
+        return false;
+
+    xcb_connection_t* c = QX11Info::connection();
+    const xcb_query_extension_reply_t* ext = xcb_get_extension_data(c, &xcb_sync_id);
+    if (!ext || !ext->present) {
+        log_debug("SYNC extension is missing, idle time is not watched");
+        return false;
+    }
+
+    xcb_sync_initialize_cookie_t initCookie = xcb_sync_initialize(c, XCB_SYNC_MAJOR_VERSION, XCB_SYNC_MINOR_VERSION);
+    xcb_sync_list_system_counters_cookie_t countersCookie = xcb_sync_list_system_counters(c);
+    free(xcb_sync_initialize_reply(c, initCookie, nullptr));
+
+    xcb_sync_list_system_counters_reply_t* counters = xcb_sync_list_system_counters_reply(c, countersCookie, nullptr);
+    if (!counters)
+        return false;
+
+    for (xcb_sync_systemcounter_iterator_t it = xcb_sync_list_system_counters_counters_iterator(counters);
+         it.rem; xcb_sync_systemcounter_next(&it)) {
+        const char* name = xcb_sync_systemcounter_name(it.data);
+        if (it.data->name_len == strlen("IDLETIME") && strncmp(name, "IDLETIME", it.data->name_len) == 0) {
+            mCounter = it.data->counter;
+            break;
+        }
+    }
+    free(counters);
+
+    if (mCounter == XCB_NONE) {
+        log_debug("X server has no IDLETIME counter");
+        return false;
+    }
+
+    mFirstEvent = ext->first_event;
+    QCoreApplication::instance()->installNativeEventFilter(this);
+    return true;
+}
+
+void IdleWatcher::setThreshold(int ms)
+{
+    if (ms == mThreshold)
+        return;
+
+    mThreshold = ms;
+    destroyAlarm(mIdleAlarm);
+    destroyAlarm(mResetAlarm);
+
+    if (mIdle) {
+        mIdle = false;
+        Q_EMIT resumed();
+    }
+
+    if (mThreshold > 0 && init())
+        mIdleAlarm = createAlarm(mThreshold, true);
+}
+
+bool IdleWatcher::isIdle() const
+{
+    return mIdle;
+}
+
+uint32_t IdleWatcher::createAlarm(int64_t value, bool positive)
+{
+    xcb_connection_t* c = QX11Info::connection();
+    const uint32_t alarm = xcb_generate_id(c);
+    const uint32_t mask = XCB_SYNC_CA_COUNTER | XCB_SYNC_CA_VALUE_TYPE | XCB_SYNC_CA_VALUE
+                        | XCB_SYNC_CA_TEST_TYPE | XCB_SYNC_CA_DELTA | XCB_SYNC_CA_EVENTS;
+    // in mask bit order, 64 bit values are sent as hi, lo
+    const uint32_t values[] = {
+        mCounter,
+        XCB_SYNC_VALUETYPE_ABSOLUTE,
+        uint32_t(value >> 32), uint32_t(value & 0xffffffff),
+        positive ? uint32_t(XCB_SYNC_TESTTYPE_POSITIVE_COMPARISON) : uint32_t(XCB_SYNC_TESTTYPE_NEGATIVE_COMPARISON),
+        0, 0,
+        1
+    };
+    xcb_sync_create_alarm(c, alarm, mask, values);
+    xcb_flush(c);
+    return alarm;
+}
+
+void IdleWatcher::destroyAlarm(uint32_t &alarm)
+{
+    if (alarm == XCB_NONE)
+        return;
+
+    xcb_connection_t* c = QX11Info::connection();
+    xcb_sync_destroy_alarm(c, alarm);
+    xcb_flush(c);
+    alarm = XCB_NONE;
+}
+
+bool IdleWatcher::nativeEventFilter(const QByteArray &eventType, void *message, long * /*result*/)
+{
+    if (eventType != "xcb_generic_event_t" || mCounter == XCB_NONE)
+        return false;
+
+    xcb_generic_event_t* event = static_cast<xcb_generic_event_t*>(message);
+    if ((event->response_type & ~0x80) != mFirstEvent + XCB_SYNC_ALARM_NOTIFY)
+        return false;
+
+    xcb_sync_alarm_notify_event_t* notify = reinterpret_cast<xcb_sync_alarm_notify_event_t*>(event);
+    const int64_t idleTime = (int64_t(notify->counter_value.hi) << 32) | notify->counter_value.lo;
+
+    // both alarms fire once and are replaced by the opposite one
+    if (notify->alarm == mIdleAlarm && !mIdle) {
+        destroyAlarm(mIdleAlarm);
+        mResetAlarm = createAlarm(idleTime - 1, false);
+        mIdle = true;
+        log_debug("user idle for %lld ms", static_cast<long long>(idleTime));
+        Q_EMIT idle();
+        return true;
+    }
+
+    if (notify->alarm == mResetAlarm && mIdle) {
+        destroyAlarm(mResetAlarm);
+        mIdleAlarm = createAlarm(mThreshold, true);
+        mIdle = false;
+        log_debug("user active again");
+        Q_EMIT resumed();
+        return true;
+    }
+
+    return false;
+}
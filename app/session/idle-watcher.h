@@ -0,0 +1,46 @@
+#ifndef IDLEWATCHER_H
+#define IDLEWATCHER_H
+
+#include <QObject>
+#include <QAbstractNativeEventFilter>
+#include <stdint.h>
+
+/**
+ * @brief Reports when the user becomes idle and active again.
+ *
+ * Uses alarms on the IDLETIME system counter of the X SYNC extension: the
+ * server notifies us when the threshold is passed and on the first input
+ * afterwards, nothing is polled.
+ */
+class IdleWatcher : public QObject, public QAbstractNativeEventFilter
+{
+    Q_OBJECT
+public:
+    explicit IdleWatcher(QObject *parent = nullptr);
+    ~IdleWatcher() override;
+
+    // 0 stops watching
+    void setThreshold(int ms);
+    bool isIdle() const;
+
+    bool nativeEventFilter(const QByteArray &eventType, void *message, long *result) override;
+
+Q_SIGNALS:
+    void idle();
+    void resumed();
+
+private:
+    bool init();
+    uint32_t createAlarm(int64_t value, bool positive);
+    void destroyAlarm(uint32_t &alarm);
+
+private:
+    uint32_t    mCounter;
+    uint8_t     mFirstEvent;
+    uint32_t    mIdleAlarm;
+    uint32_t    mResetAlarm;
+    int         mThreshold;
+    bool        mIdle;
+};
+
+#endif // IDLEWATCHER_H
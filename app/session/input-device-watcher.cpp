@@ -0,0 +1,105 @@
+#include "input-device-watcher.h"
+
+#include "input-settings.h"
+#include "udev-monitor.h"
+
+#include <graceful/log.h>
+
+#include <QX11Info>
+
+#include <xcb/xcb.h>
+#include <xcb/xinput.h>
+#include <cstdlib>
+
+#define HOTPLUG_DEBOUNCE_MS     500
+
+InputDeviceWatcher::InputDeviceWatcher(const InputSettings *settings, QObject *parent) :
+    QObject(parent),
+    mSettings(settings),
+    mMonitor(nullptr)
+{
+    // a docking station adds a burst of devices, only rescan once it is over
+    mDebounceTimer.setSingleShot(true);
+    mDebounceTimer.setInterval(HOTPLUG_DEBOUNCE_MS);
+    connect(&mDebounceTimer, &QTimer::timeout, this, &InputDeviceWatcher::scanDevices);
+}
+
+void InputDeviceWatcher::start()
+{
+    if (!QX11Info::isPlatformX11())
+        return;
+
+    const xcb_query_extension_reply_t* ext = xcb_get_extension_data(QX11Info::connection(), &xcb_input_id);
+    if (!ext || !ext->present) {
+        log_debug("XInput extension is missing, input hotplug is not handled");
+        return;
+    }
+
+    // devices present now already got the settings through the core devices
+    QList<uint16_t> keyboards, pointers;
+    if (queryDevices(keyboards, pointers)) {
+        for (uint16_t id : qAsConst(keyboards))
+            mKnownDevices.insert(id);
+        for (uint16_t id : qAsConst(pointers))
+            mKnownDevices.insert(id);
+    }
+
+    mMonitor = new UdevMonitor("input", this);
+    connect(mMonitor, &UdevMonitor::deviceChanged, this, &InputDeviceWatcher::deviceChanged);
+}
+
+void InputDeviceWatcher::deviceChanged(const QString &action)
+{
+    if (action == QLatin1String("add") || action == QLatin1String("remove"))
+        mDebounceTimer.start();
+}
+
+void InputDeviceWatcher::scanDevices()
+{
+    QList<uint16_t> keyboards, pointers;
+    if (!queryDevices(keyboards, pointers))
+        return;
+
+    QSet<uint16_t> current;
+    QList<uint16_t> newKeyboards, newPointers;
+    for (uint16_t id : qAsConst(keyboards)) {
+        current.insert(id);
+        if (!mKnownDevices.contains(id))
+            newKeyboards << id;
+    }
+    for (uint16_t id : qAsConst(pointers)) {
+        current.insert(id);
+        if (!mKnownDevices.contains(id))
+            newPointers << id;
+    }
+    mKnownDevices = current;
+
+    if (newKeyboards.isEmpty() && newPointers.isEmpty())
+        return;
+
+    log_debug("Input hotplug: %d new keyboard(s), %d new pointer(s)", newKeyboards.size(), newPointers.size());
+    mSettings->applyToDevices(newKeyboards, newPointers);
+}
+
+bool InputDeviceWatcher::queryDevices(QList<uint16_t> &keyboards, QList<uint16_t> &pointers) const
+{
+    xcb_connection_t* c = QX11Info::connection();
+    xcb_input_xi_query_device_reply_t* reply = xcb_input_xi_query_device_reply(c, xcb_input_xi_query_device(c, XCB_INPUT_DEVICE_ALL), nullptr);
+    if (!reply) {
+        log_debug("XIQueryDevice failed");
+        return false;
+    }
+
+    for (xcb_input_xi_device_info_iterator_t it = xcb_input_xi_query_device_infos_iterator(reply); it.rem; xcb_input_xi_device_info_next(&it)) {
+        const xcb_input_xi_device_info_t* info = it.data;
+        if (!info->enabled)
+            continue;
+        if (info->type == XCB_INPUT_DEVICE_TYPE_SLAVE_KEYBOARD)
+            keyboards << info->deviceid;
+        else if (info->type == XCB_INPUT_DEVICE_TYPE_SLAVE_POINTER)
+            pointers << info->deviceid;
+    }
+
+    free(reply);
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef INPUTDEVICEWATCHER_H
+#define INPUTDEVICEWATCHER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QSet>
+
+class InputSettings;
+class UdevMonitor;
+
+/**
+ * @brief Re-applies the input settings to hot-plugged keyboards and mice.
+ *
+ * udev 'input' events only trigger a (debounced) rescan of the XInput2
+ * device list, the settings are pushed to the slave devices which were
+ * not present during the previous scan.
+ */
+class InputDeviceWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit InputDeviceWatcher(const InputSettings *settings, QObject *parent = nullptr);
+
+    void start();
+
+private Q_SLOTS:
+    void deviceChanged(const QString &action);
+    void scanDevices();
+
+private:
+    bool queryDevices(QList<uint16_t> &keyboards, QList<uint16_t> &pointers) const;
+
+private:
+    const InputSettings*    mSettings;
+    UdevMonitor*            mMonitor;
+    QTimer                  mDebounceTimer;
+    QSet<uint16_t>          mKnownDevices;
+};
+
+#endif // INPUTDEVICEWATCHER_H
@@ -0,0 +1,272 @@
+#include "input-settings.h"
+#include "session-settings.h"
+
+#include <graceful/log.h>
+#include <graceful/globals.h>
+
+#include <QX11Info>
+#include <QByteArray>
+
+#include <xcb/xcb.h>
+#include <xcb/xkb.h>
+#include <xcb/xinput.h>
+#include <cstdlib>
+#include <cstring>
+
+#define XKB_NUM_VIRTUAL_MODS    16
+
+static const char NUMLOCK_NAME[] = "NumLock";
+
+/* the XKB stuff is based on code created by Oswald Buddenhagen <ossi@kde.org> */
+static uint8_t xkb_numlock_mask(xcb_atom_t numlock, const xcb_xkb_get_names_reply_t *names, const xcb_xkb_get_map_reply_t *map)
+{
+    xcb_xkb_get_names_value_list_t nameList;
+    xcb_xkb_get_names_value_list_unpack(xcb_xkb_get_names_value_list(names),
+                                        names->nTypes, names->indicators, names->virtualMods,
+                                        names->groupNames, names->nKeys, names->nKeyAliases,
+                                        names->nRadioGroups, names->which, &nameList);
+
+    xcb_xkb_get_map_map_t mapList;
+    xcb_xkb_get_map_map_unpack(xcb_xkb_get_map_map(map),
+                               map->nTypes, map->nKeySyms, map->nKeyActions, map->totalActions,
+                               map->totalKeyBehaviors, map->virtualMods, map->totalKeyExplicit,
+                               map->totalModMapKeys, map->totalVModMapKeys, map->present, &mapList);
+
+    // both lists only carry the virtual modifiers whose bit is set in the reply
+    int nameIdx = 0;
+    int mapIdx = 0;
+    for (int i = 0; i < XKB_NUM_VIRTUAL_MODS; ++i) {
+        const uint16_t bit = 1 << i;
+        xcb_atom_t name = XCB_ATOM_NONE;
+        uint8_t real = 0;
+        if (names->virtualMods & bit)
+            name = nameList.virtualModNames[nameIdx++];
+        if (map->virtualMods & bit)
+            real = mapList.vmods_rtrn[mapIdx++];
+        if (name == numlock)
+            return real;
+    }
+
+    return 0;
+}
+
+/* This function is taken from Gnome's control-center 2.6.0.3 (gnome-settings-mouse.c) and was modified*/
+static bool left_handed_mapping(QByteArray &buttons, bool mouse_left_handed)
+{
+    const int n_buttons = buttons.size();
+    int idx_1 = 0, idx_3 = 1;
+
+    for (int i = 0; i < n_buttons; i++) {
+        if (buttons[i] == 1) {
+            idx_1 = i;
+        } else if (buttons[i] == ((n_buttons < 3) ? 2 : 3)) {
+            idx_3 = i;
+        }
+    }
+
+    if ((mouse_left_handed && idx_1 < idx_3) || (!mouse_left_handed && idx_1 > idx_3)) {
+        buttons[idx_1] = ((n_buttons < 3) ? 2 : 3);
+        buttons[idx_3] = 1;
+        return true;
+    }
+
+    return false;
+}
+
+static void xkb_set_repeat_rate(xcb_connection_t *c, xcb_xkb_device_spec_t device, uint16_t delay, uint16_t interval, const uint8_t *perKeyRepeat)
+{
+    xcb_xkb_set_controls(c, device,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                         XCB_XKB_BOOL_CTRL_REPEAT_KEYS,
+                         delay, interval,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                         perKeyRepeat);
+}
+
+InputSettings::InputSettings() :
+    mRepeatDelay(-1),
+    mRepeatInterval(-1),
+    mBeep(false),
+    mNumlock(false),
+    mAccelFactor(0),
+    mAccelThreshold(0),
+    mLeftHanded(false)
+{
+}
+
+void InputSettings::readKeyboardSettings(const SessionSettings &settings)
+{
+    const QString group = QSL("Keyboard");
+    mRepeatDelay = settings.value(group, QSL("delay"), -1).toInt();
+    mRepeatInterval = settings.value(group, QSL("interval"), -1).toInt();
+    mBeep = settings.value(group, QSL("beep")).toBool();
+    mNumlock = settings.value(group, QSL("numlock")).toBool();
+}
+
+void InputSettings::readMouseSettings(const SessionSettings &settings)
+{
+    const QString group = QSL("Mouse");
+    mAccelFactor = settings.value(group, QSL("accel_factor")).toInt();
+    mAccelThreshold = settings.value(group, QSL("accel_threshold")).toInt();
+    mLeftHanded = settings.value(group, QSL("left_handed"), false).toBool();
+}
+
+void InputSettings::apply() const
+{
+    // this currently only works for X11
+    if (!QX11Info::isPlatformX11())
+        return;
+
+    xcb_connection_t* c = QX11Info::connection();
+    const xcb_query_extension_reply_t* xkbExt = xcb_get_extension_data(c, &xcb_xkb_id);
+    const bool hasXkb = xkbExt && xkbExt->present;
+
+    // 1. send every query, nothing waits for the server yet
+    xcb_xkb_use_extension_cookie_t useCookie = {0};
+    xcb_xkb_get_controls_cookie_t controlsCookie = {0};
+    xcb_intern_atom_cookie_t atomCookie = {0};
+    xcb_xkb_get_names_cookie_t namesCookie = {0};
+    xcb_xkb_get_map_cookie_t mapCookie = {0};
+    if (hasXkb) {
+        useCookie = xcb_xkb_use_extension(c, XCB_XKB_MAJOR_VERSION, XCB_XKB_MINOR_VERSION);
+        controlsCookie = xcb_xkb_get_controls(c, XCB_XKB_ID_USE_CORE_KBD);
+        if (mNumlock) {
+            // only the virtual modifier names and their real modifier mapping are needed
+            atomCookie = xcb_intern_atom(c, false, strlen(NUMLOCK_NAME), NUMLOCK_NAME);
+            namesCookie = xcb_xkb_get_names(c, XCB_XKB_ID_USE_CORE_KBD, XCB_XKB_NAME_DETAIL_VIRTUAL_MOD_NAMES);
+            mapCookie = xcb_xkb_get_map(c, XCB_XKB_ID_USE_CORE_KBD, XCB_XKB_MAP_PART_VIRTUAL_MODS, 0,
+                                        0, 0, 0, 0, 0, 0, 0, 0,
+                                        0xffff,
+                                        0, 0, 0, 0, 0, 0);
+        }
+    }
+    xcb_get_pointer_mapping_cookie_t pointerCookie = xcb_get_pointer_mapping(c);
+
+    // 2. collect the replies, this is the only round trip
+    xcb_xkb_use_extension_reply_t* useReply = nullptr;
+    xcb_xkb_get_controls_reply_t* controls = nullptr;
+    xcb_intern_atom_reply_t* atom = nullptr;
+    xcb_xkb_get_names_reply_t* names = nullptr;
+    xcb_xkb_get_map_reply_t* map = nullptr;
+    if (hasXkb) {
+        useReply = xcb_xkb_use_extension_reply(c, useCookie, nullptr);
+        controls = xcb_xkb_get_controls_reply(c, controlsCookie, nullptr);
+        if (mNumlock) {
+            atom = xcb_intern_atom_reply(c, atomCookie, nullptr);
+            names = xcb_xkb_get_names_reply(c, namesCookie, nullptr);
+            map = xcb_xkb_get_map_reply(c, mapCookie, nullptr);
+        }
+    }
+    xcb_get_pointer_mapping_reply_t* pointer = xcb_get_pointer_mapping_reply(c, pointerCookie, nullptr);
+
+    if (hasXkb && (!useReply || !useReply->supported))
+        log_debug("XKB extension is not supported by the server");
+
+    // 3. queue all changes
+    if (controls) {
+        const uint16_t delay = mRepeatDelay >= 0 ? mRepeatDelay : controls->repeatDelay;
+        const uint16_t interval = mRepeatInterval >= 0 ? mRepeatInterval : controls->repeatInterval;
+        if (delay != controls->repeatDelay || interval != controls->repeatInterval) {
+            log_debug("Keyboard repeat delay %d interval %d", delay, interval);
+            xkb_set_repeat_rate(c, XCB_XKB_ID_USE_CORE_KBD, delay, interval, controls->perKeyRepeat);
+        }
+    }
+
+    // turn on/off keyboard beep
+    const uint32_t bellPercent = mBeep ? uint32_t(-1) : 0;
+    xcb_change_keyboard_control(c, XCB_KB_BELL_PERCENT, &bellPercent);
+
+    // turn on numlock as needed
+    if (atom && names && map) {
+        const uint8_t mask = xkb_numlock_mask(atom->atom, names, map);
+        if (mask != 0)
+            xcb_xkb_latch_lock_state(c, XCB_XKB_ID_USE_CORE_KBD, mask, mask, false, 0, 0, false, 0);
+    }
+
+    if (mAccelFactor || mAccelThreshold)
+        xcb_change_pointer_control(c, mAccelFactor, 10, mAccelThreshold, mAccelFactor != 0, mAccelThreshold != 0);
+
+    // left handed mouse?
+    if (pointer) {
+        QByteArray buttons(reinterpret_cast<const char*>(xcb_get_pointer_mapping_map(pointer)),
+                           xcb_get_pointer_mapping_map_length(pointer));
+        if (left_handed_mapping(buttons, mLeftHanded)) {
+            xcb_set_pointer_mapping_cookie_t cookie = xcb_set_pointer_mapping(c, buttons.size(),
+                                                                              reinterpret_cast<const uint8_t*>(buttons.constData()));
+            xcb_discard_reply(c, cookie.sequence);
+        }
+    }
+
+    // 4. a single flush pushes everything out
+    xcb_flush(c);
+
+    free(useReply);
+    free(controls);
+    free(atom);
+    free(names);
+    free(map);
+    free(pointer);
+}
+
+void InputSettings::applyToDevices(const QList<uint16_t> &keyboards, const QList<uint16_t> &pointers) const
+{
+    if (!QX11Info::isPlatformX11())
+        return;
+
+    xcb_connection_t* c = QX11Info::connection();
+    const xcb_query_extension_reply_t* xkbExt = xcb_get_extension_data(c, &xcb_xkb_id);
+    const bool hasXkb = xkbExt && xkbExt->present && !keyboards.isEmpty();
+
+    // 1. queries, the core keyboard provides the values not set in [Keyboard]
+    xcb_xkb_get_controls_cookie_t coreCookie = {0};
+    QList<xcb_xkb_get_controls_cookie_t> kbdCookies;
+    if (hasXkb) {
+        coreCookie = xcb_xkb_get_controls(c, XCB_XKB_ID_USE_CORE_KBD);
+        for (uint16_t id : keyboards)
+            kbdCookies << xcb_xkb_get_controls(c, id);
+    }
+    QList<xcb_input_get_device_button_mapping_cookie_t> ptrCookies;
+    for (uint16_t id : pointers)
+        ptrCookies << xcb_input_get_device_button_mapping(c, id);
+
+    // 2. replies
+    if (hasXkb) {
+        xcb_xkb_get_controls_reply_t* core = xcb_xkb_get_controls_reply(c, coreCookie, nullptr);
+        for (int i = 0; i < kbdCookies.size(); ++i) {
+            xcb_xkb_get_controls_reply_t* controls = xcb_xkb_get_controls_reply(c, kbdCookies.at(i), nullptr);
+            if (controls && core) {
+                const uint16_t delay = mRepeatDelay >= 0 ? mRepeatDelay : core->repeatDelay;
+                const uint16_t interval = mRepeatInterval >= 0 ? mRepeatInterval : core->repeatInterval;
+                if (delay != controls->repeatDelay || interval != controls->repeatInterval) {
+                    log_debug("Keyboard %d repeat delay %d interval %d", keyboards.at(i), delay, interval);
+                    xkb_set_repeat_rate(c, keyboards.at(i), delay, interval, controls->perKeyRepeat);
+                }
+            }
+            free(controls);
+        }
+        free(core);
+    }
+
+    for (int i = 0; i < ptrCookies.size(); ++i) {
+        xcb_input_get_device_button_mapping_reply_t* reply = xcb_input_get_device_button_mapping_reply(c, ptrCookies.at(i), nullptr);
+        if (!reply)
+            continue;
+        QByteArray buttons(reinterpret_cast<const char*>(xcb_input_get_device_button_mapping_map(reply)),
+                           xcb_input_get_device_button_mapping_map_length(reply));
+        if (left_handed_mapping(buttons, mLeftHanded)) {
+            log_debug("Pointer %d left handed %d", pointers.at(i), mLeftHanded);
+            xcb_input_set_device_button_mapping_cookie_t cookie =
+                xcb_input_set_device_button_mapping(c, pointers.at(i), buttons.size(),
+                                                    reinterpret_cast<const uint8_t*>(buttons.constData()));
+            xcb_discard_reply(c, cookie.sequence);
+        }
+        free(reply);
+    }
+
+    // the server hands the core pointer control down to all attached slaves
+    if (!pointers.isEmpty() && (mAccelFactor || mAccelThreshold))
+        xcb_change_pointer_control(c, mAccelFactor, 10, mAccelThreshold, mAccelFactor != 0, mAccelThreshold != 0);
+
+    // 3. one flush for all devices
+    xcb_flush(c);
+}
@@ -0,0 +1,41 @@
+#ifndef INPUTSETTINGS_H
+#define INPUTSETTINGS_H
+
+#include <QList>
+#include <stdint.h>
+
+class SessionSettings;
+
+/**
+ * @brief Keyboard and pointer settings which are pushed to the X server.
+ *
+ * The values are read from the [Keyboard] and [Mouse] groups and applied
+ * through xcb in one batch: every query is sent before the first reply is
+ * awaited and all changes go out with a single flush.
+ */
+class InputSettings
+{
+public:
+    InputSettings();
+
+    void readKeyboardSettings(const SessionSettings &settings);
+    void readMouseSettings(const SessionSettings &settings);
+
+    void apply() const;
+    // only touches the given XInput slave devices, used on hotplug
+    void applyToDevices(const QList<uint16_t> &keyboards, const QList<uint16_t> &pointers) const;
+
+private:
+    // [Keyboard], a negative value keeps the server setting
+    int                 mRepeatDelay;
+    int                 mRepeatInterval;
+    bool                mBeep;
+    bool                mNumlock;
+
+    // [Mouse]
+    int                 mAccelFactor;
+    int                 mAccelThreshold;
+    bool                mLeftHanded;
+};
+
+#endif // INPUTSETTINGS_H
@@ -8,12 +8,29 @@
 #include <QDebug>
 #include <QDBusUnixFileDescriptor>
 #include <unistd.h>
+#include <fcntl.h>
+
+#define MAX_SLEEP_TIMINGS 16
 
 LockScreenManager::LockScreenManager(QObject *parent) :
     QObject(parent)
     , mProvider{nullptr}
     , mLockedBeforeSleep{false}
+    , mLockBeforeSleep{false}
+    , mSleepHold{false}
+    , mLockMs{-1}
+    , mAdoptedInhibitor{-1}
 {
+    mDeadlineTimer.setSingleShot(true);
+    connect(&mDeadlineTimer, &QTimer::timeout, this, [this] {
+        log_warn("LockScreenManager: locker too slow, releasing the sleep inhibitor");
+        release(true);
+    });
+
+    mReleaseTimer.setSingleShot(true);
+    connect(&mReleaseTimer, &QTimer::timeout, this, [this] {
+        release(false);
+    });
 }
 
 LockScreenManager::~LockScreenManager()
@@ -21,7 +38,7 @@ LockScreenManager::~LockScreenManager()
     delete mProvider;
 }
 
-bool LockScreenManager::startup(bool lockBeforeSleep, int powerAfterLockDelay)
+bool LockScreenManager::startup(bool lockBeforeSleep, int powerAfterLockDelay, int releaseDeadline)
 {
     mProvider = new LogindProvider;
     if (!mProvider->isValid()) {
@@ -39,14 +56,19 @@ bool LockScreenManager::startup(bool lockBeforeSleep, int powerAfterLockDelay)
     }
 
     log_debug("LockScreenManager:%s will be used", mProvider->metaObject()->className());
-
-    connect(&mScreenSaver, &graceful::ScreenSaver::done, this, [this, powerAfterLockDelay] {
-        if (mLockedBeforeSleep) {
-            mLockedBeforeSleep = false;
-            QTimer::singleShot(powerAfterLockDelay, this, [this] {
-                mProvider->release();
-                log_debug("LockScreenManager: after release");
-            });
+    mLockBeforeSleep = lockBeforeSleep;
+
+    // the suspend is held powerAfterLockDelay after the locker reported, but
+    // never longer than the deadline after PrepareForSleep; the deadline is
+    // at least the delay so that a locker reporting at once gets all of it
+    mReleaseTimer.setInterval(powerAfterLockDelay);
+    mDeadlineTimer.setInterval(qMax(releaseDeadline, powerAfterLockDelay));
+
+    connect(&mScreenSaver, &graceful::ScreenSaver::done, this, [this] {
+        if (mLockedBeforeSleep && mLockMs < 0) {
+            mLockMs = mSleepTimer.elapsed();
+            log_debug("LockScreenManager: locked after %lld ms", mLockMs);
+            mReleaseTimer.start();
         }
     });
 
@@ -60,25 +82,122 @@ bool LockScreenManager::startup(bool lockBeforeSleep, int powerAfterLockDelay)
             if (beforeSleep) {
                 log_debug("LockScreenManager: system is about to sleep");
                 mLockedBeforeSleep = true;
+                mLockMs = -1;
+                mSleepTimer.start();
+                mReleaseTimer.stop();
+                mDeadlineTimer.start();
                 mScreenSaver.lockScreen();
                 log_debug("LockScreenManager: after lockScreen");
             } else {
+                // logind gave up waiting for us, the inhibitor of the last
+                // cycle must go before the next one is taken
+                if (mLockedBeforeSleep)
+                    release(true);
                 inhibit();
             }
         });
 
-        inhibit();
+        if (mAdoptedInhibitor >= 0)
+            mProvider->adopt(mAdoptedInhibitor);
+        else
+            inhibit();
+    } else if (mAdoptedInhibitor >= 0) {
+        // held for the sleep modules, setSleepHold() drops it if there are none
+        mProvider->adopt(mAdoptedInhibitor);
+    }
+    mAdoptedInhibitor = -1;
+
+    connect(mProvider, &LockScreenProvider::aboutToSleep, this, &LockScreenManager::aboutToSleep);
+
+    if (!lockBeforeSleep) {
+        // connected after the forward: the modules are frozen by now
+        connect(mProvider, &LockScreenProvider::aboutToSleep, this, [this] (bool beforeSleep) {
+            if (!mSleepHold)
+                return;
+            if (beforeSleep)
+                mProvider->release();
+            else
+                inhibit();
+        });
     }
 
     return true;
 }
 
+void LockScreenManager::setSleepHold(bool hold)
+{
+    mSleepHold = hold;
+    if (!mProvider || mLockBeforeSleep)
+        return;
+
+    if (mSleepHold)
+        inhibit();
+    else
+        mProvider->release();
+}
+
 void LockScreenManager::inhibit()
 {
     if (!mProvider->inhibit())
         log_debug("LockScreenManager: could not inhibit session provider");
 }
 
+void LockScreenManager::release(bool deadline)
+{
+    if (!mLockedBeforeSleep)
+        return;
+
+    mLockedBeforeSleep = false;
+    mReleaseTimer.stop();
+    mDeadlineTimer.stop();
+    mProvider->release();
+
+    const SleepTiming timing{mLockMs, mSleepTimer.elapsed(), deadline};
+    mSleepTimings.prepend(timing);
+    while (mSleepTimings.size() > MAX_SLEEP_TIMINGS)
+        mSleepTimings.removeLast();
+
+    log_info("LockScreenManager: sleep inhibitor held %lld ms, locked after %lld ms%s",
+             timing.holdMs, timing.lockMs, deadline ? " (deadline)" : "");
+}
+
+int LockScreenManager::handOverInhibitor()
+{
+    return mProvider ? mProvider->handOver() : -1;
+}
+
+void LockScreenManager::adoptInhibitor(int fd)
+{
+    mAdoptedInhibitor = fd;
+}
+
+/**
+* @brief inheritable copy of the held inhibitor, -1 if none
+**/
+static int hand_over(const QScopedPointer<QDBusUnixFileDescriptor>& fd)
+{
+    return fd && fd->isValid() ? ::dup(fd->fileDescriptor()) : -1;
+}
+
+/**
+* @brief takes over an inhibitor handed over by hand_over()
+**/
+static void adopt(QScopedPointer<QDBusUnixFileDescriptor>& fd, int inherited)
+{
+    ::fcntl(inherited, F_SETFD, FD_CLOEXEC);
+    fd.reset(new QDBusUnixFileDescriptor);
+    fd->giveFileDescriptor(inherited);
+}
+
+QStringList LockScreenManager::sleepTimings() const
+{
+    QStringList ret;
+    for (const SleepTiming& timing : mSleepTimings)
+        ret << QSL("%1 %2 %3").arg(timing.lockMs).arg(timing.holdMs).arg(timing.deadline ? 1 : 0);
+
+    return ret;
+}
+
 
 LogindProvider::LogindProvider() :
     mInterface(QStringLiteral("org.freedesktop.login1"),
@@ -144,6 +263,16 @@ void LogindProvider::release()
     mFileDescriptor.reset(nullptr);
 }
 
+int LogindProvider::handOver()
+{
+    return hand_over(mFileDescriptor);
+}
+
+void LogindProvider::adopt(int fd)
+{
+    ::adopt(mFileDescriptor, fd);
+}
+
 /*
  * ConsoleKit2 provider
  */
@@ -220,3 +349,13 @@ void ConsoleKit2Provider::release()
 {
     mFileDescriptor.reset(nullptr);
 }
+
+int ConsoleKit2Provider::handOver()
+{
+    return hand_over(mFileDescriptor);
+}
+
+void ConsoleKit2Provider::adopt(int fd)
+{
+    ::adopt(mFileDescriptor, fd);
+}
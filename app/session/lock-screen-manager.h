@@ -4,6 +4,9 @@
 #include <QObject>
 #include <QDBusInterface>
 #include <QScopedPointer>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QList>
 #include <graceful/screensaver.h>
 
 class QDBusUnixFileDescriptor;
@@ -17,6 +20,9 @@ public:
     virtual bool isValid() = 0;
     virtual bool inhibit() = 0;
     virtual void release() = 0;
+    // the inhibitor fd survives exec, -1 if none is held
+    virtual int handOver() = 0;
+    virtual void adopt(int fd) = 0;
 
 Q_SIGNALS:
     void aboutToSleep(bool beforeSleep);
@@ -33,6 +39,8 @@ public:
     bool isValid() override;
     bool inhibit() override;
     void release() override;
+    int handOver() override;
+    void adopt(int fd) override;
 
 private:
     QDBusInterface                              mInterface;
@@ -50,6 +58,8 @@ public:
     bool isValid() override;
     bool inhibit() override;
     void release() override;
+    int handOver() override;
+    void adopt(int fd) override;
 
 private:
     QDBusInterface mInterface;
@@ -65,16 +75,54 @@ public:
     explicit LockScreenManager(QObject *parent = nullptr);
     ~LockScreenManager() override;
 
-    bool startup(bool lockBeforeSleep, int powerAfterLockDelay/*!< ms*/);
+    bool startup(bool lockBeforeSleep, int powerAfterLockDelay/*!< ms*/, int releaseDeadline/*!< ms*/);
+
+    /**
+     * @brief The last suspends, newest first: lock-to-done and inhibitor
+     * hold time in ms (lock is -1 if the locker did not report in time)
+     * and whether the deadline released the inhibitor.
+     */
+    QStringList sleepTimings() const;
+
+    // without the lock before sleep, a delay inhibitor is held only while
+    // modules are frozen for sleep; they are stopped before it goes
+    void setSleepHold(bool hold);
+
+    // the sleep inhibitor across a re-exec, adoptInhibitor() must be
+    // called before startup()
+    int handOverInhibitor();
+    void adoptInhibitor(int fd);
+
+Q_SIGNALS:
+    // forwarded from logind/ConsoleKit after the locker was asked to lock
+    void aboutToSleep(bool beforeSleep);
 
 private:
     void inhibit();
+    void release(bool deadline);
 
 private:
+    struct SleepTiming {
+        qint64  lockMs;
+        qint64  holdMs;
+        bool    deadline;
+    };
+
     LockScreenProvider*         mProvider;
 
     // screensaver
     graceful::ScreenSaver       mScreenSaver;
     bool                        mLockedBeforeSleep;
+    bool                        mLockBeforeSleep;
+    bool                        mSleepHold;
+
+    // the delay inhibitor is released at the latest when this fires
+    QTimer                      mDeadlineTimer;
+    // started when the locker reported, restarted and stopped per cycle
+    QTimer                      mReleaseTimer;
+    QElapsedTimer               mSleepTimer;
+    qint64                      mLockMs;
+    int                         mAdoptedInhibitor;
+    QList<SleepTiming>          mSleepTimings;
 };
 #endif // LOCKSCREENMANAGER_H
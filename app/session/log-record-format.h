@@ -0,0 +1,29 @@
+#ifndef LOGRECORDFORMAT_H
+#define LOGRECORDFORMAT_H
+
+/**
+ * Compact binary format of the graceful-session log, see AsyncLogger.
+ *
+ * A file starts with GRACEFUL_LOG_MAGIC, then records follow back to back:
+ * a graceful_log_record header, `fileLength` bytes of source file name and
+ * `messageLength` bytes of message, neither of them NUL terminated.
+ * graceful-session-logdump converts such a file back to text.
+ */
+
+#include <stdint.h>
+
+#define GRACEFUL_LOG_MAGIC          "GSLOG001"
+#define GRACEFUL_LOG_MAGIC_SIZE     8
+
+#pragma pack(push, 1)
+struct graceful_log_record
+{
+    int64_t         timestamp;      // ms since the epoch
+    uint32_t        line;
+    uint16_t        fileLength;
+    uint16_t        messageLength;
+    uint8_t         level;          // LOG_TRACE ... LOG_FATAL
+};
+#pragma pack(pop)
+
+#endif // LOGRECORDFORMAT_H
@@ -4,37 +4,52 @@
 #include <graceful/log.h>
 #include <graceful/globals.h>
 #include "session-application.h"
+#include "session-bootstrap.h"
+#include "async-logger.h"
 
 int main (int argc, char* argv[])
 {
-    SessionApplication app(argc, argv);
-
-    log_set_quiet(true);
-    QString logPath = QStandardPaths::writableLocation(QStandardPaths::HomeLocation) + "/.local/log/graceful-session.log";
-    FILE* lf = fopen(logPath.toUtf8().constData(), "a+");
-    if (lf) {
-        log_add_fp(lf, LOG_TRACE);
-    } else {
-        log_error("graceful-session fopen %s error!", logPath.toUtf8().constData());
+    // the bootstrap prepares the environment the application object relies on
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "-b") == 0 || qstrcmp(argv[i], "--bootstrap") == 0) {
+            SessionBootstrap::run();
+            break;
+        }
     }
 
-    log_info("start graceful-session");
+    int ret;
+    {
+        SessionApplication app(argc, argv);
 
-    QCommandLineParser parser;
-    parser.setApplicationDescription(QStringLiteral("Graceful Session"));
-    const QString VERINFO = QString("version:(%1),build by QT(%2)").arg(VERSION).arg(QStringLiteral(QT_VERSION_STR));
-    app.setApplicationVersion(VERINFO);
-    const QCommandLineOption config_opt{{("c"), ("config")}, SessionApplication::tr("Configuration file path."), SessionApplication::tr("file")};
-    const QCommandLineOption wm_opt{{("w"), ("window-manager")}, SessionApplication::tr("Window manager to use."), SessionApplication::tr("file")};
-    const auto version_opt = parser.addVersionOption();
-    const auto help_opt = parser.addHelpOption();
-    parser.addOptions({config_opt, wm_opt});
-    parser.process(app);
+        log_set_quiet(true);
+        QString logPath = QStandardPaths::writableLocation(QStandardPaths::HomeLocation) + "/.local/log/graceful-session.log";
+        if (!AsyncLogger::instance()->open(logPath)) {
+            log_error("graceful-session fopen %s error!", logPath.toUtf8().constData());
+        }
 
-    app.setConfigName(parser.value(config_opt));
-    app.setWindowManager(parser.value(wm_opt));
+        log_info("start graceful-session");
 
-    app.setQuitOnLastWindowClosed(false);
+        QCommandLineParser parser;
+        parser.setApplicationDescription(QStringLiteral("Graceful Session"));
+        const QString VERINFO = QString("version:(%1),build by QT(%2)").arg(VERSION).arg(QStringLiteral(QT_VERSION_STR));
+        app.setApplicationVersion(VERINFO);
+        const QCommandLineOption config_opt{{("c"), ("config")}, SessionApplication::tr("Configuration file path."), SessionApplication::tr("file")};
+        const QCommandLineOption wm_opt{{("w"), ("window-manager")}, SessionApplication::tr("Window manager to use."), SessionApplication::tr("file")};
+        const QCommandLineOption bootstrap_opt{{("b"), ("bootstrap")}, SessionApplication::tr("Prepare the session environment instead of start-graceful-session.")};
+        const auto version_opt = parser.addVersionOption();
+        const auto help_opt = parser.addHelpOption();
+        parser.addOptions({config_opt, wm_opt, bootstrap_opt});
+        parser.process(app);
 
-    return app.exec();
+        app.setConfigName(parser.value(config_opt));
+        app.setWindowManager(parser.value(wm_opt));
+
+        app.setQuitOnLastWindowClosed(false);
+
+        ret = app.exec();
+    }
+
+    // the modules and the application have logged their teardown by now
+    AsyncLogger::instance()->close();
+    return ret;
 }
@@ -0,0 +1,106 @@
+#include "memory-monitor.h"
+
+#include <graceful/globals.h>
+
+#include <QFile>
+#include <QDateTime>
+
+#define MAX_SAMPLES             30
+// fewer samples do not tell a leak from a warming cache
+#define MIN_LEAK_SAMPLES        10
+#define LEAK_SLOPE_KB_PER_HOUR  (8 * 1024)
+#define LEAK_MIN_FIT            0.8
+
+/**
+* @brief PSS of pid in kB; shared pages count proportionally, so a tree
+* of processes sharing libraries is not counted several times
+**/
+static qint64 process_pss(qint64 pid)
+{
+    QFile file(QSL("/proc/%1/smaps_rollup").arg(pid));
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    // "Pss:                1234 kB"
+    for (QByteArray line = file.readLine(); !line.isEmpty(); line = file.readLine()) {
+        if (line.startsWith("Pss:"))
+            return line.mid(4).trimmed().split(' ').first().toLongLong();
+    }
+
+    return 0;
+}
+
+void MemoryMonitor::sample(const QString &module, const QList<qint64> &pids)
+{
+    qint64 pss = 0;
+    for (qint64 pid : pids)
+        pss += process_pss(pid);
+
+    QList<Sample> &samples = mSamples[module];
+    samples << Sample{QDateTime::currentSecsSinceEpoch(), pss};
+    while (samples.size() > MAX_SAMPLES)
+        samples.removeFirst();
+}
+
+void MemoryMonitor::remove(const QString &module)
+{
+    mSamples.remove(module);
+}
+
+qint64 MemoryMonitor::current(const QString &module) const
+{
+    const QList<Sample> samples = mSamples.value(module);
+    return samples.isEmpty() ? -1 : samples.last().pssKb;
+}
+
+bool MemoryMonitor::fit(const QList<Sample> &samples, double *slope, double *r2) const
+{
+    const int n = samples.size();
+    if (n < 2)
+        return false;
+
+    // least squares over (hours since the first sample, kB)
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+    for (const Sample &sample : samples) {
+        const double x = (sample.time - samples.first().time) / 3600.0;
+        const double y = sample.pssKb;
+        sx += x; sy += y; sxx += x * x; sxy += x * y; syy += y * y;
+    }
+
+    const double vx = n * sxx - sx * sx;
+    const double vy = n * syy - sy * sy;
+    if (vx <= 0)
+        return false;
+
+    *slope = (n * sxy - sx * sy) / vx;
+    *r2 = vy > 0 ? (n * sxy - sx * sy) * (n * sxy - sx * sy) / (vx * vy) : 0;
+    return true;
+}
+
+qint64 MemoryMonitor::slope(const QString &module) const
+{
+    double slope = 0, r2 = 0;
+    return fit(mSamples.value(module), &slope, &r2) ? static_cast<qint64>(slope) : 0;
+}
+
+bool MemoryMonitor::leaking(const QString &module) const
+{
+    const QList<Sample> samples = mSamples.value(module);
+    double slope = 0, r2 = 0;
+    if (samples.size() < MIN_LEAK_SAMPLES || !fit(samples, &slope, &r2))
+        return false;
+
+    return slope >= LEAK_SLOPE_KB_PER_HOUR && r2 >= LEAK_MIN_FIT;
+}
+
+QStringList MemoryMonitor::report() const
+{
+    QStringList names = mSamples.keys();
+    names.sort();
+
+    QStringList ret;
+    for (const QString &name : qAsConst(names))
+        ret << QSL("%1 %2 %3 %4").arg(name).arg(current(name)).arg(slope(name)).arg(leaking(name) ? 1 : 0);
+
+    return ret;
+}
@@ -0,0 +1,43 @@
+#ifndef MEMORYMONITOR_H
+#define MEMORYMONITOR_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+/**
+ * @brief Memory trend of every module tree.
+ *
+ * Keeps the PSS of the last samples per module and fits a line through
+ * them; a steady, well fitting growth is reported as a leak.
+ */
+class MemoryMonitor
+{
+public:
+    // pids: every process of the module, the PSS is summed up
+    void sample(const QString &module, const QList<qint64> &pids);
+    void remove(const QString &module);
+
+    // kB, -1 if never sampled
+    qint64 current(const QString &module) const;
+    // kB per hour over the sample window
+    qint64 slope(const QString &module) const;
+    bool leaking(const QString &module) const;
+
+    // one line per module: PSS kB, growth kB/h and 1 if it looks like a leak
+    QStringList report() const;
+
+private:
+    struct Sample {
+        qint64  time;   // s
+        qint64  pssKb;
+    };
+
+    bool fit(const QList<Sample> &samples, double *slope, double *r2) const;
+
+private:
+    QHash<QString, QList<Sample>>   mSamples;
+};
+
+#endif // MEMORYMONITOR_H
@@ -0,0 +1,188 @@
+#include "metrics-server.h"
+
+#include "metrics.h"
+
+#include <graceful/log.h>
+#include <graceful/globals.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTimer>
+#include <QSocketNotifier>
+#include <QStandardPaths>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// clients which do not send a request get the plain text after this
+#define REQUEST_WAIT_MS     200
+#define MAX_REQUEST_SIZE    4096
+// a client which does not read its response is dropped after this
+#define RESPONSE_TIMEOUT_MS 5000
+
+MetricsServer::MetricsServer(QObject *parent) :
+    QObject(parent),
+    mFd(-1),
+    mNotifier(nullptr)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    close();
+}
+
+QString MetricsServer::path() const
+{
+    return QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + QSL("/graceful-session/metrics.sock");
+}
+
+bool MetricsServer::listen()
+{
+    if (mFd >= 0)
+        return true;
+
+    const QByteArray fileName = QFile::encodeName(path());
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (fileName.size() >= static_cast<int>(sizeof(addr.sun_path))) {
+        log_error("metrics socket path too long: %s", fileName.constData());
+        return false;
+    }
+    memcpy(addr.sun_path, fileName.constData(), fileName.size());
+
+    QDir().mkpath(QFileInfo(path()).absolutePath());
+    ::unlink(fileName.constData());
+
+    mFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (mFd < 0 || ::bind(mFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(mFd, 8) != 0) {
+        log_error("unable to listen on %s: %s", fileName.constData(), strerror(errno));
+        close();
+        return false;
+    }
+    // only the user may read the numbers
+    ::chmod(fileName.constData(), 0600);
+
+    mNotifier = new QSocketNotifier(mFd, QSocketNotifier::Read, this);
+    connect(mNotifier, &QSocketNotifier::activated, this, &MetricsServer::acceptClient);
+    log_debug("metrics on %s", fileName.constData());
+    return true;
+}
+
+void MetricsServer::close()
+{
+    const QList<int> fds = mClients.keys();
+    for (int fd : fds)
+        dropClient(fd);
+
+    delete mNotifier;
+    mNotifier = nullptr;
+    if (mFd >= 0) {
+        ::close(mFd);
+        ::unlink(QFile::encodeName(path()).constData());
+        mFd = -1;
+    }
+}
+
+void MetricsServer::acceptClient()
+{
+    const int fd = ::accept4(mFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    Client client;
+    client.notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    client.timer = new QTimer(this);
+    client.timer->setSingleShot(true);
+    connect(client.notifier, &QSocketNotifier::activated, this, [this, fd] { readClient(fd); });
+    connect(client.timer, &QTimer::timeout, this, [this, fd] { respond(fd); });
+    client.timer->start(REQUEST_WAIT_MS);
+    mClients.insert(fd, client);
+}
+
+void MetricsServer::readClient(int fd)
+{
+    auto it = mClients.find(fd);
+    if (it == mClients.end())
+        return;
+
+    char buf[1024];
+    const ssize_t len = ::read(fd, buf, sizeof(buf));
+    if (len > 0)
+        it->request.append(buf, static_cast<int>(len));
+
+    // EOF, the end of the HTTP header or garbage: answer now
+    if (len == 0 || (len < 0 && errno != EAGAIN) || it->request.contains("\r\n\r\n")
+            || it->request.size() > MAX_REQUEST_SIZE || (!it->request.isEmpty() && !it->request.startsWith("GET")))
+        respond(fd);
+}
+
+void MetricsServer::respond(int fd)
+{
+    auto it = mClients.find(fd);
+    if (it == mClients.end() || !it->response.isEmpty())
+        return;
+
+    const QByteArray body = Metrics::openMetrics();
+    if (it->request.startsWith("GET")) {
+        it->response = "HTTP/1.0 200 OK\r\n"
+                       "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                       "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                       "Connection: close\r\n\r\n";
+    }
+    it->response += body;
+
+    // the socket is non-blocking, a slow reader must not stall the session
+    it->notifier->setEnabled(false);
+    it->notifier->deleteLater();
+    it->notifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+    connect(it->notifier, &QSocketNotifier::activated, this, [this, fd] { writeClient(fd); });
+    it->timer->disconnect(this);
+    connect(it->timer, &QTimer::timeout, this, [this, fd] { dropClient(fd); });
+    it->timer->start(RESPONSE_TIMEOUT_MS);
+
+    writeClient(fd);
+}
+
+void MetricsServer::writeClient(int fd)
+{
+    auto it = mClients.find(fd);
+    if (it == mClients.end())
+        return;
+
+    while (!it->response.isEmpty()) {
+        const ssize_t written = ::send(fd, it->response.constData(), static_cast<size_t>(it->response.size()), MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;     // the notifier calls again
+        if (written <= 0)
+            break;
+        it->response.remove(0, static_cast<int>(written));
+    }
+    dropClient(fd);
+}
+
+void MetricsServer::dropClient(int fd)
+{
+    if (!mClients.contains(fd))
+        return;
+
+    const Client client = mClients.take(fd);
+    if (client.notifier) {
+        client.notifier->setEnabled(false);
+        client.notifier->deleteLater();
+    }
+    if (client.timer) {
+        client.timer->stop();
+        client.timer->deleteLater();
+    }
+    ::close(fd);
+}
@@ -0,0 +1,52 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QByteArray>
+
+class QSocketNotifier;
+class QTimer;
+
+/**
+ * @brief Serves Metrics::openMetrics() on a unix socket.
+ *
+ * A client sending an HTTP GET gets an HTTP response, a client which sends
+ * nothing (e.g. socat) gets the plain text after a short wait.
+ */
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsServer(QObject *parent = nullptr);
+    ~MetricsServer() override;
+
+    QString path() const;
+    bool listen();
+    void close();
+
+private Q_SLOTS:
+    void acceptClient();
+
+private:
+    struct Client {
+        QSocketNotifier*    notifier;
+        // the request wait, then the deadline of the response
+        QTimer*             timer;
+        QByteArray          request;
+        // what is left to send, written whenever the socket takes more
+        QByteArray          response;
+    };
+
+    void readClient(int fd);
+    void respond(int fd);
+    void writeClient(int fd);
+    void dropClient(int fd);
+
+private:
+    int                     mFd;
+    QSocketNotifier*        mNotifier;
+    QHash<int, Client>      mClients;
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,90 @@
+#include "metrics.h"
+
+#include "startup-timings.h"
+
+// upper bounds in us, the last bucket is +Inf
+static const qint64 bucket_bounds[HISTOGRAM_BUCKETS - 1] = {
+    1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000
+};
+
+std::atomic<uint64_t>   Metrics::spawns{0};
+std::atomic<uint64_t>   Metrics::crashes{0};
+std::atomic<uint64_t>   Metrics::restarts{0};
+std::atomic<uint64_t>   Metrics::reapedChildren{0};
+std::atomic<uint64_t>   Metrics::reapedOrphans{0};
+
+Histogram               Metrics::restartLatency;
+Histogram               Metrics::logoutDuration;
+Histogram               Metrics::dbusLatency;
+Histogram               Metrics::eventLoopLag;
+Histogram               Metrics::processScan;
+
+Histogram::Histogram() :
+    mCount{0},
+    mSumUs{0}
+{
+    for (auto &bucket : mBuckets)
+        bucket.store(0, std::memory_order_relaxed);
+}
+
+void Histogram::observe(qint64 us)
+{
+    int i = 0;
+    while (i < HISTOGRAM_BUCKETS - 1 && us > bucket_bounds[i])
+        ++i;
+
+    mBuckets[i].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    mSumUs.fetch_add(static_cast<uint64_t>(qMax<qint64>(us, 0)), std::memory_order_relaxed);
+}
+
+void Histogram::write(QByteArray &out, const char *name, const char *help) const
+{
+    out += "# TYPE " + QByteArray(name) + " histogram\n";
+    out += "# HELP " + QByteArray(name) + ' ' + help + '\n';
+
+    // buckets are cumulative in the exposition format
+    uint64_t cumulative = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        cumulative += mBuckets[i].load(std::memory_order_relaxed);
+        const QByteArray le = i < HISTOGRAM_BUCKETS - 1 ? QByteArray::number(bucket_bounds[i] / 1e6) : QByteArray("+Inf");
+        out += QByteArray(name) + "_bucket{le=\"" + le + "\"} " + QByteArray::number(quint64(cumulative)) + '\n';
+    }
+    out += QByteArray(name) + "_sum " + QByteArray::number(mSumUs.load(std::memory_order_relaxed) / 1e6) + '\n';
+    out += QByteArray(name) + "_count " + QByteArray::number(quint64(mCount.load(std::memory_order_relaxed))) + '\n';
+}
+
+static void write_counter(QByteArray &out, const char *name, const char *help, const std::atomic<uint64_t> &value)
+{
+    out += "# TYPE " + QByteArray(name) + " counter\n";
+    out += "# HELP " + QByteArray(name) + ' ' + help + '\n';
+    out += QByteArray(name) + "_total " + QByteArray::number(quint64(value.load(std::memory_order_relaxed))) + '\n';
+}
+
+QByteArray Metrics::openMetrics()
+{
+    QByteArray out;
+    write_counter(out, "graceful_session_spawns", "Processes started by the session.", spawns);
+    write_counter(out, "graceful_session_crashes", "Module crashes.", crashes);
+    write_counter(out, "graceful_session_restarts", "Module restarts after a crash or on request.", restarts);
+    write_counter(out, "graceful_session_reaped_children", "Children and adopted orphans reaped by the reaper thread.", reapedChildren);
+    write_counter(out, "graceful_session_reaped_orphans", "Reaped processes the session did not start, i.e. reparented orphans.", reapedOrphans);
+
+    restartLatency.write(out, "graceful_session_restart_latency_seconds", "Time from a module's exit to its restart.");
+    logoutDuration.write(out, "graceful_session_logout_duration_seconds", "Time to terminate all modules at logout.");
+    dbusLatency.write(out, "graceful_session_dbus_method_latency_seconds", "Time spent in session D-Bus methods.");
+    eventLoopLag.write(out, "graceful_session_event_loop_lag_seconds", "Delay of the main event loop.");
+    processScan.write(out, "graceful_session_process_scan_seconds", "Time to attribute the session's processes to modules.");
+
+    // written once during startup, read only afterwards
+    out += "# TYPE graceful_session_startup_phase_seconds gauge\n";
+    out += "# HELP graceful_session_startup_phase_seconds Duration of the login phases.\n";
+    const StartupTimings::PhaseList phases = StartupTimings::phases();
+    for (const auto &phase : phases) {
+        out += "graceful_session_startup_phase_seconds{phase=\"" + phase.first.toUtf8() + "\"} "
+             + QByteArray::number(phase.second / 1e3) + '\n';
+    }
+
+    out += "# EOF\n";
+    return out;
+}
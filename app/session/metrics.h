@@ -0,0 +1,66 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <atomic>
+#include <stdint.h>
+
+#define HISTOGRAM_BUCKETS 9
+
+/**
+ * @brief Latency histogram with fixed buckets.
+ *
+ * observe() only does relaxed atomic increments, it may be called from
+ * any thread without locking.
+ */
+class Histogram
+{
+public:
+    Histogram();
+
+    void observe(qint64 us);
+    void write(QByteArray &out, const char *name, const char *help) const;
+
+private:
+    std::atomic<uint64_t>   mBuckets[HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t>   mCount;
+    std::atomic<uint64_t>   mSumUs;
+};
+
+/**
+ * @brief The session wide counters, rendered as OpenMetrics text.
+ */
+class Metrics
+{
+public:
+    static std::atomic<uint64_t>    spawns;
+    static std::atomic<uint64_t>    crashes;
+    static std::atomic<uint64_t>    restarts;
+    static std::atomic<uint64_t>    reapedChildren;
+    static std::atomic<uint64_t>    reapedOrphans;
+
+    static Histogram                restartLatency;
+    static Histogram                logoutDuration;
+    static Histogram                dbusLatency;
+    static Histogram                eventLoopLag;
+    static Histogram                processScan;
+
+    static QByteArray openMetrics();
+};
+
+/**
+ * @brief Observes the lifetime of the scope into a histogram.
+ */
+class MetricsScope
+{
+public:
+    explicit MetricsScope(Histogram &histogram) : mHistogram(histogram) { mTimer.start(); }
+    ~MetricsScope() { mHistogram.observe(mTimer.nsecsElapsed() / 1000); }
+
+private:
+    Histogram&      mHistogram;
+    QElapsedTimer   mTimer;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,262 @@
+#include "module-output.h"
+
+#include <graceful/log.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define OUTPUT_RING_LINES       256
+#define OUTPUT_LINE_MAX         512
+#define OUTPUT_RATE_LINES       50      // lines per second
+#define OUTPUT_RATE_BURST       200
+
+static qint64 monotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+ModuleOutput::ModuleOutput() :
+    mEpoll(epoll_create1(EPOLL_CLOEXEC)),
+    mWakeFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+    if (mEpoll < 0 || mWakeFd < 0) {
+        log_warn("ModuleOutput: %s, module output is not captured", strerror(errno));
+        return;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = mWakeFd;
+    epoll_ctl(mEpoll, EPOLL_CTL_ADD, mWakeFd, &ev);
+}
+
+ModuleOutput::~ModuleOutput()
+{
+    stop();
+
+    for (auto it = mPipes.constBegin(); it != mPipes.constEnd(); ++it)
+        ::close(it.key());
+    qDeleteAll(mBuffers);
+
+    if (mWakeFd >= 0)
+        ::close(mWakeFd);
+    if (mEpoll >= 0)
+        ::close(mEpoll);
+}
+
+void ModuleOutput::stop()
+{
+    if (!isRunning())
+        return;
+
+    const uint64_t one = 1;
+    if (::write(mWakeFd, &one, sizeof(one)) < 0)
+        log_debug("ModuleOutput: wake up failed %s", strerror(errno));
+    QThread::wait(1000);
+}
+
+int ModuleOutput::attach(const QString &name)
+{
+    if (mEpoll < 0)
+        return -1;
+
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC | O_NONBLOCK) != 0) {
+        log_debug("ModuleOutput: pipe for %s failed %s", name.toUtf8().constData(), strerror(errno));
+        return -1;
+    }
+    // the module must not see a non-blocking stdout
+    ::fcntl(fds[1], F_SETFL, 0);
+
+    addPipe(name, fds[0]);
+    return fds[1];
+}
+
+QList<int> ModuleOutput::handOver(const QString &name)
+{
+    QList<int> fds;
+    QMutexLocker guard{&mMutex};
+    const Buffer* buffer = mBuffers.value(name);
+    for (auto it = mPipes.begin(); buffer && it != mPipes.end();) {
+        if (it->buffer != buffer) {
+            ++it;
+            continue;
+        }
+        epoll_ctl(mEpoll, EPOLL_CTL_DEL, it.key(), nullptr);
+        ::fcntl(it.key(), F_SETFD, 0);
+        fds << it.key();
+        it = mPipes.erase(it);
+    }
+    return fds;
+}
+
+void ModuleOutput::adopt(const QString &name, int fd)
+{
+    if (mEpoll < 0 || fd < 0)
+        return;
+
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    ::fcntl(fd, F_SETFL, O_NONBLOCK);
+    addPipe(name, fd);
+}
+
+void ModuleOutput::addPipe(const QString &name, int fd)
+{
+    {
+        QMutexLocker guard{&mMutex};
+        Buffer*& buffer = mBuffers[name];
+        if (!buffer) {
+            buffer = new Buffer;
+            buffer->lines.resize(OUTPUT_RING_LINES);
+            buffer->head = 0;
+            buffer->count = 0;
+            buffer->tokens = OUTPUT_RATE_BURST;
+            buffer->lastRefill = monotonic_ms();
+            buffer->dropped = 0;
+        }
+        mPipes[fd] = Pipe{buffer, QByteArray()};
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(mEpoll, EPOLL_CTL_ADD, fd, &ev);
+}
+
+void ModuleOutput::rename(const QString &from, const QString &to)
+{
+    QMutexLocker guard{&mMutex};
+    Buffer* buffer = mBuffers.take(from);
+    if (!buffer)
+        return;
+
+    Buffer* replaced = mBuffers.value(to);
+    for (auto it = mPipes.begin(); replaced && it != mPipes.end(); ++it) {
+        if (it->buffer == replaced)
+            it->buffer = buffer;
+    }
+    delete replaced;
+    mBuffers.insert(to, buffer);
+}
+
+QStringList ModuleOutput::lastLines(const QString &name, int count) const
+{
+    QMutexLocker guard{&mMutex};
+    const Buffer* buffer = mBuffers.value(name);
+    if (!buffer)
+        return QStringList();
+
+    QStringList ret;
+    count = qBound(0, count, buffer->count);
+    for (int i = buffer->count - count; i < buffer->count; ++i) {
+        const int idx = (buffer->head - buffer->count + i + OUTPUT_RING_LINES) % OUTPUT_RING_LINES;
+        ret << QString::fromLocal8Bit(buffer->lines.at(idx));
+    }
+    return ret;
+}
+
+void ModuleOutput::run()
+{
+    if (mEpoll < 0)
+        return;
+
+    struct epoll_event events[16];
+    while (true) {
+        const int n = epoll_wait(mEpoll, events, 16, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            log_debug("ModuleOutput: epoll_wait failed %s", strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.fd == mWakeFd)
+                return;
+            readPipe(events[i].data.fd);
+        }
+    }
+}
+
+void ModuleOutput::readPipe(int fd)
+{
+    char buf[4096];
+    while (true) {
+        const ssize_t len = ::read(fd, buf, sizeof(buf));
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len < 0)
+            return;     // EAGAIN, wait for more
+        if (len == 0) {
+            closePipe(fd);
+            return;
+        }
+
+        QMutexLocker guard{&mMutex};
+        const auto pipe = mPipes.find(fd);
+        if (pipe == mPipes.end())
+            return;
+
+        QByteArray& partial = pipe->partial;
+        partial.append(buf, int(len));
+        int start = 0;
+        int end;
+        while ((end = partial.indexOf('\n', start)) >= 0) {
+            appendLine(pipe->buffer, partial.mid(start, end - start));
+            start = end + 1;
+        }
+        partial.remove(0, start);
+        if (partial.size() >= OUTPUT_LINE_MAX) {
+            appendLine(pipe->buffer, partial);
+            partial.clear();
+        }
+    }
+}
+
+void ModuleOutput::appendLine(Buffer *buffer, const QByteArray &line)
+{
+    // token bucket: OUTPUT_RATE_LINES per second, bursts up to OUTPUT_RATE_BURST
+    const qint64 now = monotonic_ms();
+    buffer->tokens = qMin<double>(OUTPUT_RATE_BURST, buffer->tokens + (now - buffer->lastRefill) * OUTPUT_RATE_LINES / 1000.0);
+    buffer->lastRefill = now;
+    if (buffer->tokens < 1) {
+        ++buffer->dropped;
+        return;
+    }
+    buffer->tokens -= 1;
+
+    auto push = [buffer](const QByteArray &l) {
+        buffer->lines[buffer->head] = l;
+        buffer->head = (buffer->head + 1) % OUTPUT_RING_LINES;
+        buffer->count = qMin(buffer->count + 1, OUTPUT_RING_LINES);
+    };
+
+    if (buffer->dropped) {
+        push(QByteArray("[graceful-session: ") + QByteArray::number(buffer->dropped) + " lines dropped]");
+        buffer->dropped = 0;
+    }
+    push(line.left(OUTPUT_LINE_MAX));
+}
+
+void ModuleOutput::closePipe(int fd)
+{
+    // the mapping goes first: once closed, attach() may get the same number
+    {
+        QMutexLocker guard{&mMutex};
+        const Pipe pipe = mPipes.take(fd);
+        if (pipe.buffer && !pipe.partial.isEmpty())
+            appendLine(pipe.buffer, pipe.partial);
+    }
+
+    epoll_ctl(mEpoll, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+}
@@ -0,0 +1,69 @@
+#ifndef MODULEOUTPUT_H
+#define MODULEOUTPUT_H
+
+#include <QThread>
+#include <QMutex>
+#include <QHash>
+#include <QVector>
+#include <QByteArray>
+#include <QStringList>
+
+/**
+ * @brief Collects the stdout/stderr of the modules.
+ *
+ * Every module writes into its own pipe, a single thread reads all of them
+ * through epoll and keeps the last lines of each module in a fixed-size
+ * ring. A module which prints faster than the rate limit loses lines, the
+ * number of dropped lines is noted in its ring once it calms down.
+ */
+class ModuleOutput : public QThread
+{
+public:
+    ModuleOutput();
+    ~ModuleOutput() override;
+
+    void run() override;
+    void stop();
+
+    // returns the write end of a new pipe for the module, -1 on error
+    int attach(const QString &name);
+    // read ends of the module's pipes, no longer watched and kept open
+    // across exec, adopt() takes them back after a re-exec
+    QList<int> handOver(const QString &name);
+    void adopt(const QString &name, int fd);
+    // the ring of from goes on as the ring of to, the old ring of to is
+    // dropped and its pipes write into the renamed one
+    void rename(const QString &from, const QString &to);
+    QStringList lastLines(const QString &name, int count) const;
+
+private:
+    struct Buffer {
+        QVector<QByteArray>     lines;
+        int                     head;
+        int                     count;
+        double                  tokens;
+        qint64                  lastRefill;
+        quint64                 dropped;
+    };
+
+    // instances of one module may write at the same time (children
+    // outliving a restart, a retired instance), lines are split per pipe
+    struct Pipe {
+        Buffer*                 buffer;
+        QByteArray              partial;
+    };
+
+    void addPipe(const QString &name, int fd);
+    void readPipe(int fd);
+    void appendLine(Buffer *buffer, const QByteArray &line);
+    void closePipe(int fd);
+
+private:
+    int                         mEpoll;
+    int                         mWakeFd;
+    mutable QMutex              mMutex;
+    QHash<QString, Buffer*>     mBuffers;
+    QHash<int, Pipe>            mPipes;
+};
+
+#endif // MODULEOUTPUT_H
@@ -1,6 +0,0 @@
-#ifndef NUMLOCK_H
-#define NUMLOCK_H
-
-void enableNumlock();
-
-#endif // NUMLOCK_H
@@ -0,0 +1,116 @@
+#include "power-source-watcher.h"
+
+#include "udev-monitor.h"
+
+#include <graceful/log.h>
+#include <graceful/globals.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileSystemWatcher>
+
+#define SYSFS_ROOT              "/sys"
+// plugging in sends several events for the charger and each battery
+#define POWER_DEBOUNCE_MS       1000
+
+PowerSourceWatcher::PowerSourceWatcher(QObject *parent) :
+    QObject(parent),
+    mMonitor(nullptr),
+    mWatcher(nullptr),
+    mOnBattery(false)
+{
+    mDebounceTimer.setSingleShot(true);
+    mDebounceTimer.setInterval(POWER_DEBOUNCE_MS);
+    connect(&mDebounceTimer, &QTimer::timeout, this, &PowerSourceWatcher::update);
+}
+
+void PowerSourceWatcher::setSysfsRoot(const QString &root)
+{
+    const QString newRoot = root.isEmpty() ? QSL(SYSFS_ROOT) : root;
+    if (newRoot == mRoot)
+        return;
+    mRoot = newRoot;
+
+    delete mMonitor;
+    mMonitor = nullptr;
+    delete mWatcher;
+    mWatcher = nullptr;
+
+    if (mRoot == QL1S(SYSFS_ROOT)) {
+        mMonitor = new UdevMonitor("power_supply", this);
+        connect(mMonitor, &UdevMonitor::deviceChanged, &mDebounceTimer, [this] { mDebounceTimer.start(); });
+    } else {
+        // sysfs has no inotify, a fake tree has
+        mWatcher = new QFileSystemWatcher(this);
+        mWatcher->addPath(mRoot + QSL("/class/power_supply"));
+        watchSupplies();
+        connect(mWatcher, &QFileSystemWatcher::fileChanged, &mDebounceTimer, [this] { mDebounceTimer.start(); });
+        connect(mWatcher, &QFileSystemWatcher::directoryChanged, &mDebounceTimer, [this] {
+            // a supply added later has files of its own to watch
+            watchSupplies();
+            mDebounceTimer.start();
+        });
+    }
+
+    update();
+}
+
+void PowerSourceWatcher::watchSupplies()
+{
+    const QString dir = mRoot + QSL("/class/power_supply");
+    const QStringList watched = mWatcher->files();
+    for (const QString &supply : QDir(dir).entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        for (const char *name : {"online", "status"}) {
+            const QString path = dir + QLatin1Char('/') + supply + QLatin1Char('/') + QL1S(name);
+            if (!watched.contains(path) && QFile::exists(path))
+                mWatcher->addPath(path);
+        }
+    }
+}
+
+bool PowerSourceWatcher::onBattery() const
+{
+    return mOnBattery;
+}
+
+void PowerSourceWatcher::update()
+{
+    const bool onBattery = readOnBattery();
+    if (onBattery == mOnBattery)
+        return;
+
+    mOnBattery = onBattery;
+    log_info("power source: %s", mOnBattery ? "battery" : "AC");
+    Q_EMIT onBatteryChanged(mOnBattery);
+}
+
+bool PowerSourceWatcher::readOnBattery() const
+{
+    const QStringList supplies = QDir(mRoot + QSL("/class/power_supply")).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+
+    bool discharging = false;
+    for (const QString &supply : supplies) {
+        const QString type = readAttribute(supply, "type");
+        if (type == QL1S("Battery")) {
+            // peripherals (mice, headsets) report their own batteries
+            if (readAttribute(supply, "scope") != QL1S("Device"))
+                discharging |= readAttribute(supply, "status") == QL1S("Discharging");
+        } else if (type == QL1S("Mains") || type == QL1S("Wireless") || type.startsWith(QL1S("USB"))) {
+            // USB-C and USB PD chargers report USB, older kernels USB_C, USB_PD...
+            if (readAttribute(supply, "online") == QL1S("1"))
+                return false;
+        }
+    }
+
+    // desktops have no battery, some laptops do not report their charger
+    return discharging;
+}
+
+QString PowerSourceWatcher::readAttribute(const QString &supply, const char *name) const
+{
+    QFile file(mRoot + QSL("/class/power_supply/") + supply + QLatin1Char('/') + QL1S(name));
+    if (!file.open(QIODevice::ReadOnly))
+        return QString();
+
+    return QString::fromLatin1(file.readAll()).trimmed();
+}
@@ -0,0 +1,47 @@
+#ifndef POWERSOURCEWATCHER_H
+#define POWERSOURCEWATCHER_H
+
+#include <QObject>
+#include <QTimer>
+
+class UdevMonitor;
+class QFileSystemWatcher;
+
+/**
+ * @brief Tells whether the machine runs on battery.
+ *
+ * The power supplies are read from <root>/class/power_supply: the machine
+ * runs on battery when no Mains, USB or wireless charger is online and a
+ * system battery is discharging.
+ * Changes arrive as udev 'power_supply' events; a root other than /sys
+ * (a fake tree) is watched with inotify instead.
+ */
+class PowerSourceWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PowerSourceWatcher(QObject *parent = nullptr);
+
+    void setSysfsRoot(const QString &root);
+    bool onBattery() const;
+
+Q_SIGNALS:
+    void onBatteryChanged(bool onBattery);
+
+private Q_SLOTS:
+    void update();
+
+private:
+    void watchSupplies();
+    bool readOnBattery() const;
+    QString readAttribute(const QString &supply, const char *name) const;
+
+private:
+    QString                 mRoot;
+    UdevMonitor*            mMonitor;
+    QFileSystemWatcher*     mWatcher;
+    QTimer                  mDebounceTimer;
+    bool                    mOnBattery;
+};
+
+#endif // POWERSOURCEWATCHER_H
@@ -1,9 +1,12 @@
 #include "proc-reaper.h"
+#include "metrics.h"
 
 #include <graceful/log.h>
 #if defined(Q_OS_LINUX)
 #include <sys/prctl.h>
 #include <proc/readproc.h>
+#include <dirent.h>
+#include <cstdio>
 #elif defined(Q_OS_FREEBSD)
 #include <sys/procctl.h>
 #include <libutil.h>
@@ -45,11 +48,23 @@ void ProcReaper::run()
         }
 
         int status;
-        pid = ::waitpid(-1, &status, WNOHANG);
+        bool orphan = false;
+        {
+            // under the lock, reap() must not miss a status on its way
+            QMutexLocker guard{&mMutex};
+            pid = ::waitpid(-1, &status, WNOHANG);
+            if (pid > 0 && mWatched.count(pid))
+                mStatuses[pid] = status;
+            if (pid > 0)
+                orphan = mWatched.count(pid) == 0 && mExpected.erase(pid) == 0;
+        }
         if (pid < 0) {
             if (ECHILD != errno)
                 log_debug("waitpid failed %s", strerror(errno));
         } else if (pid > 0) {
+            ++Metrics::reapedChildren;
+            if (orphan)
+                ++Metrics::reapedOrphans;
             if (WIFEXITED(status))
                 log_debug("Child process %d exited with status %s", pid, strerror(errno));
             else if (WIFSIGNALED(status))
@@ -73,12 +88,113 @@ void ProcReaper::stop(const std::set<int64_t> & excludedPids)
             return;
     }
     // send term to all children
-    const pid_t my_pid = ::getpid();
+    const std::vector<pid_t> children = ProcReaper::children(::getpid());
+    for (auto const & child : children) {
+        if (excludedPids.count(child) == 0) {
+            log_debug("Sending TERM to child %d", child);
+            ::kill(child, SIGTERM);
+        }
+    }
+    mWait.wakeAll();
+    {
+        QMutexLocker guard{&mMutex};
+        mShouldRun = false;
+    }
+
+    QThread::wait(5000); // 5 seconds
+}
+
+void ProcReaper::watch(pid_t pid)
+{
+    QMutexLocker guard{&mMutex};
+    mWatched.insert(pid);
+}
+
+void ProcReaper::expect(pid_t pid)
+{
+    QMutexLocker guard{&mMutex};
+    mExpected.insert(pid);
+}
+
+void ProcReaper::forget(pid_t pid)
+{
+    QMutexLocker guard{&mMutex};
+    mExpected.erase(pid);
+}
+
+pid_t ProcReaper::reap(pid_t pid, int & status)
+{
+    QMutexLocker guard{&mMutex};
+    const auto it = mStatuses.find(pid);
+    if (it != mStatuses.end()) {
+        status = it->second;
+        mStatuses.erase(it);
+        mWatched.erase(pid);
+        return pid;
+    }
+
+    const pid_t ret = ::waitpid(pid, &status, WNOHANG);
+    if (ret != 0)
+        mWatched.erase(pid);
+    return ret;
+}
+
+std::vector<pid_t> ProcReaper::children(pid_t pid)
+{
+#if defined(Q_OS_LINUX)
+    // the kernel lists the children per thread, reading that is much
+    // cheaper than parsing the stat file of every process on the system
+    std::vector<pid_t> children;
+    if (taskChildren(pid, children))
+        return children;
+#endif
+    return scanChildren(pid);
+}
+
+/**
+* @brief children of all threads of pid from /proc/<pid>/task/<tid>/children,
+* false if the kernel does not provide these files
+**/
+bool ProcReaper::taskChildren(pid_t pid, std::vector<pid_t> & children)
+{
+#if defined(Q_OS_LINUX)
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIR * tasks = ::opendir(path);
+    if (!tasks)
+        return false;
+
+    bool found = false;
+    while (struct dirent * task = ::readdir(tasks)) {
+        if (task->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "/proc/%d/task/%s/children", pid, task->d_name);
+        FILE * f = ::fopen(path, "re");
+        if (!f)
+            continue;
+        found = true;
+        int child;
+        while (::fscanf(f, "%d", &child) == 1)
+            children.push_back(child);
+        ::fclose(f);
+    }
+    ::closedir(tasks);
+
+    return found;
+#else
+    Q_UNUSED(pid)
+    Q_UNUSED(children)
+    return false;
+#endif
+}
+
+std::vector<pid_t> ProcReaper::scanChildren(pid_t pid)
+{
     std::vector<pid_t> children;
 #if defined(Q_OS_LINUX)
     PROCTAB * proc_dir = ::openproc(PROC_FILLSTAT);
     while (proc_t * proc = ::readproc(proc_dir, nullptr)) {
-        if (proc->ppid == my_pid) {
+        if (proc->ppid == pid) {
             children.push_back(proc->tgid);
         }
         ::freeproc(proc);
@@ -88,24 +204,12 @@ void ProcReaper::stop(const std::set<int64_t> & excludedPids)
     int cnt = 0;
     if (kinfo_proc *proc_info = kinfo_getallproc(&cnt))  {
         for (int i = 0; i < cnt; ++i) {
-            if (proc_info[i].ki_ppid == my_pid) {
+            if (proc_info[i].ki_ppid == pid) {
                 children.push_back(proc_info[i].ki_pid);
             }
         }
         free(proc_info);
     }
 #endif
-    for (auto const & child : children) {
-        if (excludedPids.count(child) == 0) {
-            log_debug("Seding TERM to child %s", child);
-            ::kill(child, SIGTERM);
-        }
-    }
-    mWait.wakeAll();
-    {
-        QMutexLocker guard{&mMutex};
-        mShouldRun = false;
-    }
-
-    QThread::wait(5000); // 5 seconds
+    return children;
 }
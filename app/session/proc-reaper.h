@@ -4,6 +4,9 @@
 #include <QMutex>
 #include <QWaitCondition>
 #include <set>
+#include <map>
+#include <vector>
+#include <sys/types.h>
 
 class ProcReaper : public QThread
 {
@@ -13,10 +16,31 @@ public:
 public:
     virtual void run() override;
     void stop(const std::set<int64_t> & excludedPids);
+
+    // the exit status of a watched pid is kept for reap() instead of dropped
+    void watch(pid_t pid);
+    // like waitpid(pid, WNOHANG): pid with its status, 0 while it runs and
+    // -1 if it is no child or its status was not kept
+    pid_t reap(pid_t pid, int & status);
+
+    // children the session started itself; every other child reaped is
+    // an orphan reparented to the subreaper
+    void expect(pid_t pid);
+    void forget(pid_t pid);
+
+    // direct children of pid, from the kernel's per-thread lists when it has them
+    static std::vector<pid_t> children(pid_t pid);
+    // only the per-thread lists, false if the kernel has none or pid is gone
+    static bool taskChildren(pid_t pid, std::vector<pid_t> & children);
+    // direct children of pid, found by reading every process on the system
+    static std::vector<pid_t> scanChildren(pid_t pid);
 private:
     bool                mShouldRun;
     QMutex              mMutex;
     QWaitCondition      mWait;
+    std::set<pid_t>     mWatched;
+    std::map<pid_t, int> mStatuses;
+    std::set<pid_t>     mExpected;
 };
 
 #endif // PROCREAPER_H
@@ -0,0 +1,181 @@
+#include "process-tree.h"
+#include "proc-reaper.h"
+
+#include <QSet>
+#include <QStringList>
+
+#include <proc/readproc.h>
+#include <unistd.h>
+#include <cstdio>
+#include <vector>
+
+namespace {
+struct Entry {
+    qint64  ppid;
+    qint64  cpuMs;
+    qint64  rssKb;
+    quint64 startTime;
+    int     threads;
+};
+}
+
+static Entry make_entry(const proc_t* proc)
+{
+    static const long ticks = sysconf(_SC_CLK_TCK);
+    static const long pageKb = sysconf(_SC_PAGESIZE) / 1024;
+
+    return Entry{proc->ppid, qint64(proc->utime + proc->stime) * 1000 / ticks, qint64(proc->rss) * pageKb, quint64(proc->start_time), proc->nlwp};
+}
+
+/**
+* @brief stat of every process on the system, with the children of each pid
+**/
+static void read_all(QHash<qint64, Entry> &all, QHash<qint64, QList<qint64>> &children)
+{
+    PROCTAB* proc_dir = ::openproc(PROC_FILLSTAT);
+    while (proc_t* proc = ::readproc(proc_dir, nullptr)) {
+        all.insert(proc->tgid, make_entry(proc));
+        children[proc->ppid] << proc->tgid;
+        ::freeproc(proc);
+    }
+    ::closeproc(proc_dir);
+}
+
+/**
+* @brief stat of the listed processes, the ones which are gone are skipped
+**/
+static void read_stats(const QList<qint64> &pids, QHash<qint64, Entry> &all)
+{
+    if (pids.isEmpty())
+        return;
+
+    std::vector<pid_t> list(pids.begin(), pids.end());
+    list.push_back(0);
+    PROCTAB* proc_dir = ::openproc(PROC_FILLSTAT | PROC_PID, list.data());
+    while (proc_t* proc = ::readproc(proc_dir, nullptr)) {
+        all.insert(proc->tgid, make_entry(proc));
+        ::freeproc(proc);
+    }
+    ::closeproc(proc_dir);
+}
+
+/**
+* @brief children of pid, a single threaded process has only one list to read
+**/
+static void read_children(qint64 pid, int threads, std::vector<pid_t> &children)
+{
+    if (threads != 1) {
+        ProcReaper::taskChildren(static_cast<pid_t>(pid), children);
+        return;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%lld/task/%lld/children", pid, pid);
+    if (FILE* f = ::fopen(path, "re")) {
+        int child;
+        while (::fscanf(f, "%d", &child) == 1)
+            children.push_back(child);
+        ::fclose(f);
+    }
+}
+
+void ProcessTree::update(const QHash<QString, qint64> &roots)
+{
+    // with the children lists of the kernel only the module trees are read,
+    // otherwise every process of the system is
+    static const bool taskChildren = ::access("/proc/thread-self/children", R_OK) == 0;
+
+    QHash<qint64, Entry> all;
+    QHash<qint64, QList<qint64>> children;
+    if (taskChildren) {
+        QList<qint64> seeds = mProcesses.keys();
+        for (qint64 pid : roots)
+            seeds << pid;
+        read_stats(seeds, all);
+    } else {
+        read_all(all, children);
+    }
+
+    // known processes keep their module, even when reparented to us; a pid
+    // which started anew belongs to an unrelated process
+    QHash<qint64, QString> owner;
+    for (auto it = mProcesses.constBegin(); it != mProcesses.constEnd(); ++it) {
+        const auto entry = all.constFind(it.key());
+        if (entry != all.constEnd() && entry->startTime == it->startTime)
+            owner.insert(it.key(), it->module);
+    }
+    for (auto it = roots.constBegin(); it != roots.constEnd(); ++it) {
+        if (all.contains(it.value()))
+            owner.insert(it.value(), it.key());
+    }
+
+    QList<qint64> queue = owner.keys();
+    while (!queue.isEmpty()) {
+        const qint64 pid = queue.takeFirst();
+        const QString module = owner.value(pid);
+
+        QList<qint64> fresh;
+        if (taskChildren) {
+            std::vector<pid_t> pids;
+            read_children(pid, all.value(pid).threads, pids);
+            for (pid_t child : pids) {
+                if (!owner.contains(child))
+                    fresh << child;
+            }
+            read_stats(fresh, all);
+        } else {
+            for (qint64 child : children.value(pid)) {
+                if (!owner.contains(child))
+                    fresh << child;
+            }
+        }
+
+        for (qint64 child : qAsConst(fresh)) {
+            // gone between the children list and its stat
+            if (!all.contains(child))
+                continue;
+            owner.insert(child, module);
+            queue << child;
+        }
+    }
+
+    mProcesses.clear();
+    for (auto it = owner.constBegin(); it != owner.constEnd(); ++it) {
+        const Entry &entry = all[it.key()];
+        mProcesses.insert(it.key(), Process{it.value(), entry.cpuMs, entry.rssKb, entry.startTime});
+    }
+}
+
+QList<qint64> ProcessTree::members(const QString &module) const
+{
+    QList<qint64> ret;
+    for (auto it = mProcesses.constBegin(); it != mProcesses.constEnd(); ++it) {
+        if (it->module == module)
+            ret << it.key();
+    }
+
+    return ret;
+}
+
+ProcessTree::Usage ProcessTree::usage(const QString &module) const
+{
+    Usage ret{0, 0, 0};
+    for (const Process &process : mProcesses) {
+        if (process.module != module)
+            continue;
+        ++ret.processes;
+        ret.cpuMs += process.cpuMs;
+        ret.rssKb += process.rssKb;
+    }
+
+    return ret;
+}
+
+QStringList ProcessTree::modules() const
+{
+    QSet<QString> ret;
+    for (const Process &process : mProcesses)
+        ret.insert(process.module);
+
+    return ret.values();
+}
@@ -0,0 +1,46 @@
+#ifndef PROCESSTREE_H
+#define PROCESSTREE_H
+
+#include <QHash>
+#include <QString>
+#include <QList>
+
+/**
+ * @brief Which module each process of the session belongs to.
+ *
+ * Descendants are attributed while their parent is alive; once a process
+ * is reparented to the session (the subreaper) it keeps its module, and
+ * so do the children it spawns afterwards.
+ *
+ * Only the known processes and the descendants of the roots are read;
+ * without the kernel's children lists every process on the system is.
+ */
+class ProcessTree
+{
+public:
+    struct Usage {
+        int         processes;
+        qint64      cpuMs;
+        qint64      rssKb;
+    };
+
+    // roots: module name -> pid of the module process
+    void update(const QHash<QString, qint64> &roots);
+
+    QList<qint64> members(const QString &module) const;
+    Usage usage(const QString &module) const;
+    QStringList modules() const;
+
+private:
+    struct Process {
+        QString     module;
+        qint64      cpuMs;
+        qint64      rssKb;
+        // tells a reused pid from the process we knew
+        quint64     startTime;
+    };
+
+    QHash<qint64, Process>  mProcesses;
+};
+
+#endif // PROCESSTREE_H
@@ -2,34 +2,89 @@
 
 #include "session-dbus-adaptor.h"
 #include "graceful-modman.h"
-#include "num-lock.h"
 #include "lock-screen-manager.h"
+#include "input-device-watcher.h"
+#include "session-settings.h"
+#include "startup-timings.h"
+#include "shortcut-manager.h"
+#include "idle-watcher.h"
+#include "metrics-server.h"
+#include "power-source-watcher.h"
+#include "async-logger.h"
 #include <unistd.h>
 #include <csignal>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/mman.h>
 #include <graceful/settings.h>
 #include <graceful/globals.h>
 #include <QProcess>
+#include <QSocketNotifier>
+#include <QStandardPaths>
+#include <QIcon>
+#include <QFile>
+#include <QVector>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDir>
 #include <graceful/log.h>
 
-#include <QX11Info>
-#include <X11/XKBlib.h>
-
-#include <graceful/qhotkey.h>
-#include <graceful/settings.h>
+#define STATE_ENV "GRACEFUL_SESSION_STATE"
 
 using namespace graceful;
 
+static int signal_sock[2] = {-1, -1};
+
+static void signal_handler(int signo)
+{
+    // only async-signal-safe calls here, the rest happens in readUnixSignal()
+    int ret = write(signal_sock[0], &signo, sizeof(int));
+    Q_UNUSED(ret);
+}
+
 SessionApplication::SessionApplication(int& argc, char** argv) :
-    graceful::Application(argc, argv),
-    lockScreenManager(new LockScreenManager(this))
+    QGuiApplication(argc, argv),
+    sessionSettings(new SessionSettings(this)),
+    inputDeviceWatcher(new InputDeviceWatcher(&inputSettings, this)),
+    lockScreenManager(new LockScreenManager(this)),
+    idleWatcher(new IdleWatcher(this)),
+    metricsServer(new MetricsServer(this)),
+    powerWatcher(new PowerSourceWatcher(this)),
+    idleThrottle(GracefulModule::IdlePriority),
+    batteryThrottle(GracefulModule::IdlePriority),
+    batteryIntervalScale(4),
+    sleepModules(false),
+    signalNotifier(nullptr)
 {
     listenToUnixSignals({SIGINT, SIGTERM, SIGQUIT, SIGHUP});
 
+    qDBusRegisterMetaType<QMap<QString, QString>>();
+
     initSettings();
 
     modman = new GracefulModuleManager;
-    connect(this, &graceful::Application::unixSignal, modman, [this] { modman->logout(true); });
-    new SessionDBusAdaptor(modman);
+    connect(this, &SessionApplication::unixSignal, modman, [this] { modman->logout(true); });
+    shortcutManager = new ShortcutManager(modman, this);
+    new SessionDBusAdaptor(modman, shortcutManager, lockScreenManager);
+
+    connect(idleWatcher, &IdleWatcher::idle, modman, [this] {
+        modman->throttleBackgroundModules(idleThrottle);
+        modman->setUserIdle(true);
+    });
+    connect(idleWatcher, &IdleWatcher::resumed, modman, [this] {
+        modman->setUserIdle(false);
+        modman->throttleBackgroundModules(GracefulModule::NoThrottle);
+    });
+    connect(powerWatcher, &PowerSourceWatcher::onBatteryChanged, modman, [this] (bool onBattery) {
+        modman->setOnBattery(onBattery, batteryThrottle, batteryIntervalScale);
+    });
+    connect(lockScreenManager, &LockScreenManager::aboutToSleep, modman, [this] (bool beforeSleep) {
+        // thawed in any case, the modules may have changed since the freeze
+        if (!beforeSleep)
+            modman->thawAfterSleep();
+        else if (sleepModules)
+            modman->freezeForSleep();
+    });
 
     QDBusConnection::sessionBus().registerService(QSL("org.graceful.session"));
     QDBusConnection::sessionBus().registerObject(QSL("/GracefulSession"), modman);
@@ -43,6 +98,36 @@ SessionApplication::~SessionApplication()
     delete modman;
 }
 
+void SessionApplication::listenToUnixSignals(const QList<int>& signos)
+{
+    if (!signalNotifier) {
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, signal_sock) != 0) {
+            log_error("unable to create the signal socket pair");
+            return;
+        }
+        signalNotifier = new QSocketNotifier(signal_sock[1], QSocketNotifier::Read, this);
+        connect(signalNotifier, &QSocketNotifier::activated, this, &SessionApplication::readUnixSignal);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    for (int signo : signos)
+        sigaction(signo, &sa, nullptr);
+}
+
+void SessionApplication::readUnixSignal()
+{
+    int signo = 0;
+    if (read(signal_sock[1], &signo, sizeof(int)) != sizeof(int))
+        return;
+
+    log_info("received signal %d", signo);
+    Q_EMIT unixSignal(signo);
+}
+
 void SessionApplication::setWindowManager(const QString& windowManager)
 {
     modman->setWindowManager(windowManager);
@@ -57,38 +142,185 @@ void SessionApplication::setConfigName(const QString& configName)
     qputenv("GRACEFUL_SESSION_CONFIG", this->configName.toLocal8Bit());
 }
 
-bool SessionApplication::startup()
+void SessionApplication::reexec()
 {
-    Settings settings(configName);
-    log_debug("Session %s about to launch (default 'session')", configName.toUtf8().constData());
-
-    loadEnvironmentSettings(settings);
-    loadKeyboardSettings(settings);
-    loadMouseSettings(settings);
-    initShotcuts();
-
-    if (lockScreenManager->startup(settings.value(QLatin1String("lock_screen_before_power_actions"), true).toBool(),
-                                   settings.value(QLatin1String("power_actions_after_lock_delay"), 0).toInt())) {
-        log_debug("LockScreenManager started successfully");
-    } else {
-        log_debug("LockScreenManager couldn't start");
+    QString program = arguments().value(0);
+    if (!program.contains(QLatin1Char('/')))
+        program = QStandardPaths::findExecutable(program);
+    // /proc/self/exe would run the replaced binary again
+    if (program.isEmpty() || access(QFile::encodeName(program).constData(), X_OK) != 0) {
+        log_error("re-exec: no executable for %s", qPrintable(arguments().value(0)));
+        return;
     }
 
-    // launch module manager and autostart apps
-    modman->startup(settings);
+    const int fd = memfd_create("graceful-session-state", 0);
+    if (fd < 0) {
+        log_error("re-exec: memfd_create failed %s", strerror(errno));
+        return;
+    }
 
+    QJsonObject state = modman->saveState();
+    state[QSL("inhibitor")] = lockScreenManager->handOverInhibitor();
+    const QByteArray data = QJsonDocument(state).toJson(QJsonDocument::Compact);
+    if (::write(fd, data.constData(), data.size()) != data.size() || ::lseek(fd, 0, SEEK_SET) != 0) {
+        log_error("re-exec: unable to write the state %s", strerror(errno));
+        ::close(fd);
+        modman->adoptState(state);
+        ::close(state.value(QSL("inhibitor")).toInt(-1));
+        return;
+    }
+
+    // the environment was prepared by this image already
+    QList<QByteArray> args;
+    for (const QString& arg : arguments()) {
+        if (arg != QL1S("-b") && arg != QL1S("--bootstrap"))
+            args << arg.toLocal8Bit();
+    }
+    QVector<char*> argv;
+    for (QByteArray& arg : args)
+        argv << arg.data();
+    argv << nullptr;
+
+    qputenv(STATE_ENV, QByteArray::number(fd));
+    log_info("re-exec %s with %d bytes of state", qPrintable(program), data.size());
+    AsyncLogger::instance()->close();
+
+    execv(QFile::encodeName(program).constData(), argv.data());
+
+    // still the old image: take the handed over output pipes back
+    const int err = errno;
+    AsyncLogger::instance()->resume();
+    log_error("re-exec of %s failed %s", qPrintable(program), strerror(err));
+    qunsetenv(STATE_ENV);
+    ::close(fd);
+    modman->adoptState(state);
+    ::close(state.value(QSL("inhibitor")).toInt(-1));
+}
+
+/**
+ * @brief Takes over the state of the image which exec'ed this one, false
+ * for a normal login.
+ */
+bool SessionApplication::adoptState()
+{
+    bool ok = false;
+    const int fd = qEnvironmentVariableIntValue(STATE_ENV, &ok);
+    qunsetenv(STATE_ENV);
+    if (!ok)
+        return false;
+
+    QFile file;
+    if (!file.open(fd, QIODevice::ReadOnly, QFileDevice::AutoCloseHandle)) {
+        log_error("unable to read the state of the previous image");
+        ::close(fd);
+        return false;
+    }
+    const QJsonObject state = QJsonDocument::fromJson(file.readAll()).object();
+    if (state.isEmpty())
+        return false;
+
+    lockScreenManager->adoptInhibitor(state.value(QSL("inhibitor")).toInt(-1));
+    modman->adoptState(state);
     return true;
 }
 
-void SessionApplication::initShotcuts()
+bool SessionApplication::startup()
 {
-    auto hotkey = new QHotkey(QKeySequence("ctrl+alt+t"), true, this);
-    connect(hotkey, &QHotkey::activated, qApp, [&]() {
-        if (QFile::exists("/bin/gnome-terminal")) {
-            QProcess::startDetached("/bin/gnome-terminal");
+    const bool reexecuted = adoptState();
+
+    {
+        StartupTimings::Phase phase(QSL("settings"));
+        sessionSettings->load(configName);
+        loadLogSettings();
+        log_debug("Session %s about to launch (default 'session')", configName.toUtf8().constData());
+
+        loadEnvironmentSettings(sessionSettings->keys(QSL("Environment")));
+
+        // modules map the effective settings instead of parsing the ini files
+        qputenv("GRACEFUL_SESSION_SNAPSHOT", QFile::encodeName(settingsSnapshot.path()));
+        settingsSnapshot.publish(*sessionSettings);
+    }
+
+    {
+        StartupTimings::Phase phase(QSL("input"));
+        loadKeyboardSettings();
+        loadMouseSettings();
+        inputSettings.apply();
+        inputDeviceWatcher->start();
+        shortcutManager->load(*sessionSettings);
+    }
+
+    {
+        StartupTimings::Phase phase(QSL("lockscreen"));
+        if (lockScreenManager->startup(sessionSettings->value(QSL("General"), QLatin1String("lock_screen_before_power_actions"), true).toBool(),
+                                       sessionSettings->value(QSL("General"), QLatin1String("power_actions_after_lock_delay"), 0).toInt(),
+                                       sessionSettings->value(QSL("General"), QLatin1String("lock_screen_release_deadline"), 3000).toInt())) {
+            log_debug("LockScreenManager started successfully");
+        } else {
+            log_debug("LockScreenManager couldn't start");
         }
+    }
+
+    {
+        StartupTimings::Phase phase(QSL("modules"));
+        // launch module manager and autostart apps
+        loadUpgradeSettings();
+        loadPowerSettings();
+        modman->setSessionFile(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QSL("/graceful-session/session.json"));
+        modman->startup(*sessionSettings);
+        if (!reexecuted && sessionSettings->value(QSL("General"), QSL("restore_session"), false).toBool())
+            modman->restoreSession();
+        loadIdleSettings();
+        loadSleepSettings();
+        loadMemorySettings();
+    }
+    loadMetricsSettings();
+    StartupTimings::dump();
+
+    // from now on only the changed parts are applied again
+    connect(sessionSettings, &SessionSettings::groupChanged, this, &SessionApplication::settingsChanged);
+    connect(modman, &GracefulModuleManager::themeUpdated, this, [this] {
+        settingsSnapshot.publish(*sessionSettings);
     });
 
+    return true;
+}
+
+void SessionApplication::settingsChanged(const QString& group, const QStringList& keys)
+{
+    if (group == QL1S("Log")) {
+        loadLogSettings();
+    } else if (group == QL1S("Environment")) {
+        // modules started from now on inherit the new values
+        loadEnvironmentSettings(keys);
+    } else if (group == QL1S("Keyboard")) {
+        static const QStringList layoutKeys = {QSL("layout"), QSL("variant"), QSL("model"), QSL("options")};
+        bool layoutChanged = false;
+        for (const QString& key : keys)
+            layoutChanged |= layoutKeys.contains(key);
+        loadKeyboardSettings(layoutChanged);
+        inputSettings.apply();
+    } else if (group == QL1S("Mouse")) {
+        bool cursorChanged = keys.contains(QSL("cursor_theme")) || keys.contains(QSL("cursor_size"));
+        loadMouseSettings(cursorChanged);
+        inputSettings.apply();
+    } else if (group == QL1S("Shortcuts")) {
+        shortcutManager->load(*sessionSettings);
+    } else if (group == QL1S("Idle")) {
+        loadIdleSettings();
+    } else if (group == QL1S("Sleep")) {
+        loadSleepSettings();
+    } else if (group == QL1S("MemoryBudget")) {
+        loadMemorySettings();
+    } else if (group == QL1S("Power")) {
+        loadPowerSettings();
+    } else if (group == QL1S("Upgrade")) {
+        loadUpgradeSettings();
+    } else if (group == QL1S("General") && keys.contains(QSL("metrics"))) {
+        loadMetricsSettings();
+    }
+
+    settingsSnapshot.publish(*sessionSettings);
 }
 
 void SessionApplication::initSettings()
@@ -133,16 +365,149 @@ void SessionApplication::mergeXrdb(const char* content, int len)
     xrdb.waitForFinished();
 }
 
-void SessionApplication::loadEnvironmentSettings(Settings& settings)
+void SessionApplication::loadEnvironmentSettings(const QStringList& keys)
+{
+    // in file order, a key may refer to the keys above it
+    QStringList ordered;
+    for (const QString& key : sessionSettings->keys(QSL("Environment"))) {
+        if (keys.contains(key))
+            ordered << key;
+    }
+    for (const QString& key : keys) {
+        if (!ordered.contains(key))
+            ordered << key;     // removed from the file
+    }
+
+    // expand the whole block first, it is pushed to D-Bus in one call
+    QMap<QByteArray, QByteArray> block;
+    for(const QString& i : qAsConst(ordered)) {
+        const QVariant value = sessionSettings->value(QSL("Environment"), i);
+        if (!value.isValid()) {
+            log_debug("Environment variable %s removed", i.toLocal8Bit().constData());
+            qunsetenv(i.toLocal8Bit().constData());
+            continue;
+        }
+        block[i.toLocal8Bit()] = graceful_expand_env(value.toByteArray(), block);
+    }
+
+    for (auto it = block.constBegin(); it != block.constEnd(); ++it) {
+        log_debug("Environment variable %s=%s", it.key().constData(), it.value().constData());
+        qputenv(it.key().constData(), it.value());
+    }
+
+    // $VAR in Exec lines refers to the new values on the next start
+    modman->environmentChanged();
+    updateActivationEnvironment(block);
+}
+
+void SessionApplication::updateActivationEnvironment(const QMap<QByteArray, QByteArray>& block)
+{
+    if (block.isEmpty())
+        return;
+
+    QMap<QString, QString> env;
+    for (auto it = block.constBegin(); it != block.constEnd(); ++it)
+        env[QString::fromLocal8Bit(it.key())] = QString::fromLocal8Bit(it.value());
+
+    // one call for the whole block, nobody waits for the reply
+    QDBusMessage msg = QDBusMessage::createMethodCall(QSL("org.freedesktop.DBus"),
+                                                      QSL("/org/freedesktop/DBus"),
+                                                      QSL("org.freedesktop.DBus"),
+                                                      QSL("UpdateActivationEnvironment"));
+    msg << QVariant::fromValue(env);
+    QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(msg), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [](QDBusPendingCallWatcher* w) {
+        if (w->isError())
+            log_debug("UpdateActivationEnvironment failed: %s", w->error().message().toUtf8().constData());
+        w->deleteLater();
+    });
+}
+
+void SessionApplication::loadLogSettings()
+{
+    const QString group = QSL("Log");
+    AsyncLogger* logger = AsyncLogger::instance();
+    logger->setLevel(sessionSettings->value(group, QSL("level"), LOG_TRACE).toInt());
+    logger->setFormat(sessionSettings->value(group, QSL("format")).toString() == QL1S("binary") ? AsyncLogger::Binary : AsyncLogger::Text);
+    // max_size is given in KiB
+    logger->setRotation(sessionSettings->value(group, QSL("max_size"), 4096).toLongLong() * 1024,
+                        sessionSettings->value(group, QSL("max_files"), 3).toInt());
+}
+
+/**
+ * @brief throttle of a freeze|priority|none setting, priority by default
+ */
+static GracefulModule::Throttle throttle_setting(const QString& action)
+{
+    if (action == QL1S("freeze"))
+        return GracefulModule::Frozen;
+    if (action == QL1S("none"))
+        return GracefulModule::NoThrottle;
+    return GracefulModule::IdlePriority;
+}
+
+void SessionApplication::loadIdleSettings()
 {
-    settings.beginGroup(QSL("Environment"));
-    QByteArray envVal;
-    const QStringList keys = settings.childKeys();
-    for(const QString& i : keys) {
-        envVal = settings.value(i).toByteArray();
-        graceful_setenv(i.toLocal8Bit().constData(), envVal);
+    const QString group = QSL("Idle");
+    idleThrottle = throttle_setting(sessionSettings->value(group, QSL("action"), QSL("priority")).toString());
+
+    modman->setBackgroundModules(sessionSettings->value(group, QSL("modules")).toStringList());
+    // threshold is given in seconds, 0 disables the throttling
+    idleWatcher->setThreshold(sessionSettings->value(group, QSL("threshold"), 300).toInt() * 1000);
+    if (idleWatcher->isIdle())
+        modman->throttleBackgroundModules(idleThrottle);
+}
+
+void SessionApplication::loadPowerSettings()
+{
+    const QString group = QSL("Power");
+    // background modules are only throttled on battery when asked for
+    batteryThrottle = throttle_setting(sessionSettings->value(group, QSL("battery_action"), QSL("none")).toString());
+    // the sampling intervals and the lag probe are multiplied on battery
+    batteryIntervalScale = sessionSettings->value(group, QSL("battery_sample_scale"), 4).toInt();
+    powerWatcher->setSysfsRoot(sessionSettings->value(group, QSL("sysfs_root"), QSL("/sys")).toString());
+    modman->setOnBattery(powerWatcher->onBattery(), batteryThrottle, batteryIntervalScale);
+}
+
+void SessionApplication::loadSleepSettings()
+{
+    const QString group = QSL("Sleep");
+    // thaw_stagger is given in ms
+    modman->setSleepModules(sessionSettings->value(group, QSL("modules")).toStringList(),
+                            sessionSettings->value(group, QSL("thaw_stagger"), 100).toInt());
+    // the freeze needs the suspend delayed until it is done
+    sleepModules = modman->hasSleepModules();
+    lockScreenManager->setSleepHold(sleepModules);
+}
+
+void SessionApplication::loadMemorySettings()
+{
+    // module=MiB entries, plus the restart switch
+    const QString group = QSL("MemoryBudget");
+    QHash<QString, qint64> budgets;
+    const QStringList keys = sessionSettings->keys(group);
+    for (const QString& key : keys) {
+        if (key != QL1S("restart"))
+            budgets[key] = sessionSettings->value(group, key).toLongLong() * 1024;
     }
-    settings.endGroup();
+
+    modman->setMemoryBudgets(budgets, sessionSettings->value(group, QSL("restart"), false).toBool());
+}
+
+void SessionApplication::loadUpgradeSettings()
+{
+    // overlap is given in ms, 0 keeps running modules on their old binary
+    modman->setUpgradeOverlap(sessionSettings->value(QSL("Upgrade"), QSL("overlap"), 0).toInt());
+}
+
+void SessionApplication::loadMetricsSettings()
+{
+    const bool enabled = sessionSettings->value(QSL("General"), QSL("metrics"), false).toBool();
+    if (enabled)
+        metricsServer->listen();
+    else
+        metricsServer->close();
+    modman->setLagProbe(enabled);
 }
 
 void SessionApplication::setxkbmap(QString layout, QString variant, QString model, QStringList options) {
@@ -171,113 +536,47 @@ void SessionApplication::setxkbmap(QString layout, QString variant, QString mode
         QProcess::startDetached(QStringLiteral("setxkbmap"), args);
 }
 
-void SessionApplication::loadKeyboardSettings(Settings& settings)
+void SessionApplication::loadKeyboardSettings(bool layoutChanged)
 {
-    log_debug("%s", settings.fileName().toUtf8().constData());
-    settings.beginGroup(QSL("Keyboard"));
-    XKeyboardControl values;
-    /* Keyboard settings */
-    unsigned int delay = 0;
-    unsigned int interval = 0;
-    if(XkbGetAutoRepeatRate(QX11Info::display(), XkbUseCoreKbd, (unsigned int*) &delay, (unsigned int*) &interval)) {
-        delay = settings.value(QSL("delay"), delay).toUInt();
-        interval = settings.value(QSL("interval"), interval).toUInt();
-        XkbSetAutoRepeatRate(QX11Info::display(), XkbUseCoreKbd, delay, interval);
-    }
-
-    // turn on/off keyboard beep
-    bool beep = settings.value(QSL("beep")).toBool();
-    values.bell_percent = beep ? -1 : 0;
-    XChangeKeyboardControl(QX11Info::display(), KBBellPercent, &values);
-
-    // turn on numlock as needed
-    if(settings.value("numlock").toBool())
-        enableNumlock();
+    log_debug("%s", sessionSettings->fileName().toUtf8().constData());
+    const QString group = QSL("Keyboard");
+    inputSettings.readKeyboardSettings(*sessionSettings);
 
     // keyboard layout support using setxkbmap
-    QString layout = settings.value(QSL("layout")).toString();
-    QString variant = settings.value(QSL("variant")).toString();
-    QString model = settings.value(QSL("model")).toString();
-    QStringList options = settings.value(QSL("options")).toStringList();
-    setxkbmap(layout, variant, model, options);
-
-    settings.endGroup();
+    if (layoutChanged) {
+        QString layout = sessionSettings->value(group, QSL("layout")).toString();
+        QString variant = sessionSettings->value(group, QSL("variant")).toString();
+        QString model = sessionSettings->value(group, QSL("model")).toString();
+        QStringList options = sessionSettings->value(group, QSL("options")).toStringList();
+        setxkbmap(layout, variant, model, options);
+    }
 }
 
-void SessionApplication::loadMouseSettings(Settings& settings)
+void SessionApplication::loadMouseSettings(bool cursorChanged)
 {
-    settings.beginGroup(QSL("Mouse"));
+    const QString group = QSL("Mouse");
 
     // mouse cursor (does this work?)
-    QString cursorTheme = settings.value(QSL("cursor_theme")).toString();
-    int cursorSize = settings.value(QSL("cursor_size")).toInt();
-    QByteArray buf;
-    if(!cursorTheme.isEmpty()) {
-        buf += QBAL("Xcursor.theme:");
-        buf += cursorTheme.toLocal8Bit();
-        buf += QBAL("\n");
-    }
-    if(cursorSize > 0) {
-        buf += QBAL("Xcursor.size:");
-        buf += QByteArray::number(cursorSize);
-        buf += QBAL("\n");
-    }
-    if(!buf.isEmpty()) {
-        buf += QBAL("Xcursor.theme_core:true\n");
-        mergeXrdb(buf.constData(), buf.length());
-    }
-
-    // other mouse settings
-    int accel_factor = settings.value(QSL("accel_factor")).toInt();
-    int accel_threshold = settings.value(QSL("accel_threshold")).toInt();
-    if(accel_factor || accel_threshold)
-        XChangePointerControl(QX11Info::display(), accel_factor != 0, accel_threshold != 0, accel_factor, 10, accel_threshold);
-
-    // left handed mouse?
-    bool left_handed = settings.value(QSL("left_handed"), false).toBool();
-    setLeftHandedMouse(left_handed);
-
-    settings.endGroup();
-}
-
-/* This function is taken from Gnome's control-center 2.6.0.3 (gnome-settings-mouse.c) and was modified*/
-#define DEFAULT_PTR_MAP_SIZE 128
-void SessionApplication::setLeftHandedMouse(bool mouse_left_handed)
-{
-    unsigned char *buttons = nullptr;
-    unsigned char *more_buttons = nullptr;
-    int n_buttons = 0;
-    int i = 0;
-    int idx_1 = 0, idx_3 = 1;
-
-    buttons = (unsigned char*)malloc(DEFAULT_PTR_MAP_SIZE);
-    if (!buttons) {
-        return;
-    }
-    n_buttons = XGetPointerMapping(QX11Info::display(), buttons, DEFAULT_PTR_MAP_SIZE);
-    if (n_buttons > DEFAULT_PTR_MAP_SIZE) {
-        more_buttons = (unsigned char*)realloc(buttons, n_buttons);
-        if (!more_buttons) {
-            free(buttons);
-            return;
+    if (cursorChanged) {
+        QString cursorTheme = sessionSettings->value(group, QSL("cursor_theme")).toString();
+        int cursorSize = sessionSettings->value(group, QSL("cursor_size")).toInt();
+        QByteArray buf;
+        if(!cursorTheme.isEmpty()) {
+            buf += QBAL("Xcursor.theme:");
+            buf += cursorTheme.toLocal8Bit();
+            buf += QBAL("\n");
         }
-        buttons = more_buttons;
-        n_buttons = XGetPointerMapping(QX11Info::display(), buttons, n_buttons);
-    }
-
-    for (i = 0; i < n_buttons; i++) {
-        if (buttons[i] == 1) {
-            idx_1 = i;
-        } else if (buttons[i] == ((n_buttons < 3) ? 2 : 3)) {
-            idx_3 = i;
+        if(cursorSize > 0) {
+            buf += QBAL("Xcursor.size:");
+            buf += QByteArray::number(cursorSize);
+            buf += QBAL("\n");
+        }
+        if(!buf.isEmpty()) {
+            buf += QBAL("Xcursor.theme_core:true\n");
+            mergeXrdb(buf.constData(), buf.length());
         }
     }
 
-    if ((mouse_left_handed && idx_1 < idx_3) || (!mouse_left_handed && idx_1 > idx_3)) {
-        buttons[idx_1] = ((n_buttons < 3) ? 2 : 3);
-        buttons[idx_3] = 1;
-        XSetPointerMapping(QX11Info::display(), buttons, n_buttons);
-    }
-
-    free(buttons);
+    // other mouse settings
+    inputSettings.readMouseSettings(*sessionSettings);
 }
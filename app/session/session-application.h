@@ -2,14 +2,29 @@
 #define SESSIONAPPLICATION_H
 
 #include "lock-screen-manager.h"
+#include "input-settings.h"
+#include "settings-snapshot.h"
+#include "graceful-modman.h"
 
-#include <graceful/application.h>
+#include <QGuiApplication>
 #include <graceful/settings.h>
 
 class LockScreenManager;
-class GracefulModuleManager;
+class InputDeviceWatcher;
+class SessionSettings;
+class ShortcutManager;
+class IdleWatcher;
+class MetricsServer;
+class PowerSourceWatcher;
+class QSocketNotifier;
 
-class SessionApplication : public graceful::Application
+/**
+ * @brief The session core.
+ *
+ * Only QtGui is loaded (for the X connection, icons and shortcuts), the
+ * dialogs live in graceful-session-ui and are started on demand.
+ */
+class SessionApplication : public QGuiApplication
 {
     Q_OBJECT
 public:
@@ -18,24 +33,55 @@ public:
     void setWindowManager(const QString &windowManager);
     void setConfigName(const QString &configName);
 
+public Q_SLOTS:
+    // replaces the running image with the installed binary, the modules
+    // keep running and are adopted by the new image
+    void reexec();
+
+Q_SIGNALS:
+    void unixSignal(int signo);
+
 private Q_SLOTS:
     bool startup();
+    void settingsChanged(const QString &group, const QStringList &keys);
+    void readUnixSignal();
 
 private:
-    void initShotcuts();
+    void listenToUnixSignals(const QList<int> &signos);
+    bool adoptState();
     void initSettings();
-    void loadMouseSettings(graceful::Settings &settings);
-    void loadKeyboardSettings(graceful::Settings &settings);
-    void loadEnvironmentSettings(graceful::Settings &settings);
+    void loadMouseSettings(bool cursorChanged = true);
+    void loadKeyboardSettings(bool layoutChanged = true);
+    void loadEnvironmentSettings(const QStringList &keys);
+    void loadLogSettings();
+    void loadIdleSettings();
+    void loadSleepSettings();
+    void loadMemorySettings();
+    void loadMetricsSettings();
+    void loadUpgradeSettings();
+    void loadPowerSettings();
+    void updateActivationEnvironment(const QMap<QByteArray, QByteArray> &block);
     void setxkbmap(QString layout, QString variant, QString model, QStringList options);
 
     void mergeXrdb(const char *content, int len);
-    void setLeftHandedMouse(bool mouse_left_handed);
 
 private:
     QString                     configName;
+    SessionSettings*            sessionSettings;
+    SettingsSnapshot            settingsSnapshot;
+    InputSettings               inputSettings;
+    InputDeviceWatcher*         inputDeviceWatcher;
     LockScreenManager*          lockScreenManager;
     GracefulModuleManager*      modman;
+    ShortcutManager*            shortcutManager;
+    IdleWatcher*                idleWatcher;
+    MetricsServer*              metricsServer;
+    PowerSourceWatcher*         powerWatcher;
+    GracefulModule::Throttle    idleThrottle;
+    GracefulModule::Throttle    batteryThrottle;
+    int                         batteryIntervalScale;
+    bool                        sleepModules;
+    QSocketNotifier*            signalNotifier;
 };
 
 #endif // SESSIONAPPLICATION_H
@@ -0,0 +1,259 @@
+#include "session-bootstrap.h"
+
+#include "graceful-modman.h"
+#include "startup-timings.h"
+
+#include <graceful/log.h>
+
+#include <QDir>
+#include <QFile>
+#include <QList>
+#include <QElapsedTimer>
+
+#include <future>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <xcb/xcb.h>
+#include <gio/gio.h>
+
+#define REGION_SCHEMA   "org.gnome.system.locale"
+
+static bool contains_path(const QByteArray &list, const QByteArray &path)
+{
+    const QList<QByteArray> parts = list.split(':');
+    return parts.contains(path);
+}
+
+static void setenv_default(const char *name, const QByteArray &value)
+{
+    if (qgetenv(name).isEmpty())
+        qputenv(name, value);
+}
+
+void SessionBootstrap::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    setupXdgDirs();
+
+    // the slow steps do not depend on each other
+    std::future<Environment> dbus;
+    if (needDBus())
+        dbus = std::async(std::launch::async, &SessionBootstrap::launchDBus);
+    std::future<void> root = std::async(std::launch::async, &SessionBootstrap::cleanupRootProperties);
+    std::future<QByteArray> regionValue = std::async(std::launch::async, &SessionBootstrap::region);
+
+    createDesktopDir();
+    setupDefaults();
+
+    const QByteArray reg = regionValue.get();
+    if (!reg.isEmpty()) {
+        for (const char* lc : {"LC_TIME", "LC_NUMERIC", "LC_MONETARY", "LC_MEASUREMENT", "LC_PAPER"})
+            qputenv(lc, reg);
+    }
+
+    if (dbus.valid()) {
+        const Environment env = dbus.get();
+        for (auto it = env.constBegin(); it != env.constEnd(); ++it)
+            qputenv(it.key().constData(), it.value());
+    }
+    root.wait();
+
+    StartupTimings::record(QStringLiteral("bootstrap"), timer.elapsed());
+}
+
+void SessionBootstrap::setupXdgDirs()
+{
+    const QByteArray home = qgetenv("HOME");
+    setenv_default("XDG_DATA_HOME", home + "/.local/share");
+    setenv_default("XDG_CONFIG_HOME", home + "/.config");
+    setenv_default("XDG_CACHE_HOME", home + "/.cache");
+
+    QByteArray dataDirs = qgetenv("XDG_DATA_DIRS");
+    if (dataDirs.isEmpty())
+        dataDirs = qgetenv("XDG_DATA_HOME") + ":/usr/local/share:/usr/share";
+    else if (!contains_path(dataDirs, "/usr/share"))
+        dataDirs += ":/usr/share";
+    qputenv("XDG_DATA_DIRS", dataDirs);
+
+    QByteArray configDirs = qgetenv("XDG_CONFIG_DIRS");
+    if (configDirs.isEmpty())
+        configDirs = "/etc:/etc/xdg:/usr/share";
+    else if (!contains_path(configDirs, "/etc/xdg"))
+        configDirs += ":/etc/xdg";
+    qputenv("XDG_CONFIG_DIRS", configDirs);
+}
+
+/**
+ * @brief ensure the existence of the 'Desktop' folder
+ **/
+void SessionBootstrap::createDesktopDir()
+{
+    QByteArray desktop = qgetenv("HOME") + "/Desktop";
+
+    QFile dirs(QFile::decodeName(qgetenv("XDG_CONFIG_HOME") + "/user-dirs.dirs"));
+    if (dirs.open(QIODevice::ReadOnly)) {
+        while (!dirs.atEnd()) {
+            const QByteArray line = dirs.readLine().trimmed();
+            if (!line.startsWith("XDG_DESKTOP_DIR="))
+                continue;
+            QByteArray value = line.mid(int(strlen("XDG_DESKTOP_DIR=")));
+            if (value.startsWith('"') && value.endsWith('"') && value.size() >= 2)
+                value = value.mid(1, value.size() - 2);
+            desktop = graceful_expand_env(value);
+        }
+    }
+
+    QDir().mkpath(QFile::decodeName(desktop));
+}
+
+bool SessionBootstrap::needDBus()
+{
+    if (!qgetenv("DBUS_SESSION_BUS_ADDRESS").isEmpty())
+        return false;
+
+    const QByteArray runtimeDir = qgetenv("XDG_RUNTIME_DIR");
+    if (runtimeDir.isEmpty())
+        return true;
+
+    struct stat st;
+    const QByteArray bus = runtimeDir + "/bus";
+    return ::stat(bus.constData(), &st) != 0 || !S_ISSOCK(st.st_mode) || st.st_uid != ::getuid();
+}
+
+SessionBootstrap::Environment SessionBootstrap::launchDBus()
+{
+    Environment env;
+
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC) != 0)
+        return env;
+
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return env;
+    }
+    if (pid == 0) {
+        ::dup2(fds[1], STDOUT_FILENO);
+        ::execlp("dbus-launch", "dbus-launch", "--exit-with-session", static_cast<char*>(nullptr));
+        ::_exit(127);
+    }
+    ::close(fds[1]);
+
+    // plain syntax: one NAME=value per line
+    QByteArray out;
+    char buf[512];
+    ssize_t n;
+    while ((n = ::read(fds[0], buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        out.append(buf, int(n));
+    }
+    ::close(fds[0]);
+
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+
+    const QList<QByteArray> lines = out.split('\n');
+    for (const QByteArray &line : lines) {
+        const int eq = line.indexOf('=');
+        if (eq > 0)
+            env[line.left(eq)] = line.mid(eq + 1);
+    }
+
+    if (!env.contains("DBUS_SESSION_BUS_ADDRESS"))
+        log_error("graceful-session: error executing dbus-launch");
+
+    return env;
+}
+
+/**
+ * @brief clean up after GDM (GDM sets the number of desktops to one)
+ **/
+void SessionBootstrap::cleanupRootProperties()
+{
+    int screenNum = 0;
+    xcb_connection_t* c = xcb_connect(nullptr, &screenNum);
+    if (xcb_connection_has_error(c)) {
+        xcb_disconnect(c);
+        return;
+    }
+
+    xcb_screen_iterator_t it = xcb_setup_roots_iterator(xcb_get_setup(c));
+    for (int i = 0; i < screenNum && it.rem; ++i)
+        xcb_screen_next(&it);
+    if (!it.rem) {
+        xcb_disconnect(c);
+        return;
+    }
+    const xcb_window_t root = it.data->root;
+
+    static const char* const names[] = {"_NET_NUMBER_OF_DESKTOPS", "_NET_DESKTOP_NAMES", "_NET_CURRENT_DESKTOP"};
+    xcb_intern_atom_cookie_t cookies[3];
+    for (int i = 0; i < 3; ++i)
+        cookies[i] = xcb_intern_atom(c, true, strlen(names[i]), names[i]);
+
+    for (int i = 0; i < 3; ++i) {
+        xcb_intern_atom_reply_t* reply = xcb_intern_atom_reply(c, cookies[i], nullptr);
+        if (reply && reply->atom != XCB_ATOM_NONE)
+            xcb_delete_property(c, root, reply->atom);
+        free(reply);
+    }
+
+    xcb_flush(c);
+    xcb_disconnect(c);
+}
+
+QByteArray SessionBootstrap::region()
+{
+    // a missing schema would abort inside g_settings_new()
+    GSettingsSchemaSource* source = g_settings_schema_source_get_default();
+    if (!source)
+        return QByteArray();
+    GSettingsSchema* schema = g_settings_schema_source_lookup(source, REGION_SCHEMA, TRUE);
+    if (!schema)
+        return QByteArray();
+    g_settings_schema_unref(schema);
+
+    GSettings* settings = g_settings_new(REGION_SCHEMA);
+    gchar* value = g_settings_get_string(settings, "region");
+    const QByteArray region(value);
+    g_free(value);
+    g_object_unref(settings);
+
+    return region;
+}
+
+void SessionBootstrap::setupDefaults()
+{
+    // Qt4 platform plugin
+    qputenv("QT_PLATFORM_PLUGIN", "graceful");
+    // Qt5 platform plugin
+    qputenv("QT_QPA_PLATFORMTHEME", "graceful");
+
+    // ibus
+    qputenv("GTK_IM_MODULE", "ibus");
+    qputenv("QT_IM_MODULE", "ibus");
+    qputenv("XMODIFIERS", "@im=ibus");
+
+    qputenv("COLORTERM", "truecolor");
+    qputenv("GTK3_MODULES", "xapp-gtk3-module");
+
+    qputenv("XDG_MENU_PREFIX", "graceful-");
+    qputenv("XDG_CURRENT_DESKTOP", "GracefulLinux");
+
+    // default editor
+    qputenv("EDITOR", "/usr/bin/vim");
+}
@@ -0,0 +1,32 @@
+#ifndef SESSIONBOOTSTRAP_H
+#define SESSIONBOOTSTRAP_H
+
+#include <QByteArray>
+#include <QMap>
+
+/**
+ * @brief Native replacement of the start-graceful-session script.
+ *
+ * Must run before the application object exists: it prepares the
+ * environment the session bus connection and the modules depend on.
+ * The slow steps (dbus-launch, X root cleanup, GSettings lookup) run
+ * in parallel, only the main thread touches the environment.
+ */
+class SessionBootstrap
+{
+public:
+    static void run();
+
+private:
+    typedef QMap<QByteArray, QByteArray> Environment;
+
+    static void setupXdgDirs();
+    static void createDesktopDir();
+    static bool needDBus();
+    static Environment launchDBus();
+    static void cleanupRootProperties();
+    static QByteArray region();
+    static void setupDefaults();
+};
+
+#endif // SESSIONBOOTSTRAP_H
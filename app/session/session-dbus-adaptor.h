@@ -4,6 +4,10 @@
 #include <graceful/power.h>
 
 #include "graceful-modman.h"
+#include "async-logger.h"
+#include "shortcut-manager.h"
+#include "lock-screen-manager.h"
+#include "metrics.h"
 
 
 class SessionDBusAdaptor : public QDBusAbstractAdaptor
@@ -12,16 +16,20 @@ class SessionDBusAdaptor : public QDBusAbstractAdaptor
     Q_CLASSINFO("D-Bus Interface", "org.graceful.session")
 
 public:
-    SessionDBusAdaptor(GracefulModuleManager * manager)
+    SessionDBusAdaptor(GracefulModuleManager * manager, ShortcutManager * shortcuts, LockScreenManager * lockScreen)
         : QDBusAbstractAdaptor(manager),
         m_manager(manager),
+        m_shortcuts(shortcuts),
+        m_lockScreen(lockScreen),
         m_power(false/*don't use ourself, just all other power providers*/)
     {
         connect(m_manager, &GracefulModuleManager::moduleStateChanged, this, &SessionDBusAdaptor::moduleStateChanged);
+        connect(m_manager, &GracefulModuleManager::themeUpdated, this, &SessionDBusAdaptor::themeChanged);
     }
 
 Q_SIGNALS:
     void moduleStateChanged(QString moduleName, bool state);
+    void themeChanged(QString theme);
 
 public Q_SLOTS:
     bool canLogout()
@@ -31,11 +39,13 @@ public Q_SLOTS:
 
     bool canReboot()
     {
+        MetricsScope scope(Metrics::dbusLatency);
         return m_power.canReboot();
     }
 
     bool canPowerOff()
     {
+        MetricsScope scope(Metrics::dbusLatency);
         return m_power.canShutdown();
     }
 
@@ -58,23 +68,83 @@ public Q_SLOTS:
         QCoreApplication::exit(0);
     }
 
+    // the reply is sent before the exec is queued, the caller must not
+    // lose its connection while it waits for the answer; QDBusContext is
+    // not set up for adaptors, the message comes in as the last argument
+    Q_NOREPLY void reexec(const QDBusMessage& msg)
+    {
+        QDBusConnection::sessionBus().send(msg.createReply());
+        QTimer::singleShot(0, qApp, SLOT(reexec()));
+    }
+
     QDBusVariant listModules()
     {
+        MetricsScope scope(Metrics::dbusLatency);
         return QDBusVariant(m_manager->listModules());
     }
 
     Q_NOREPLY void startModule(const QString& name)
     {
+        MetricsScope scope(Metrics::dbusLatency);
         m_manager->startProcess(name);
     }
 
     Q_NOREPLY void stopModule(const QString& name)
     {
+        MetricsScope scope(Metrics::dbusLatency);
         m_manager->stopProcess(name);
     }
 
+    QStringList moduleOutput(const QString& name, int lines)
+    {
+        MetricsScope scope(Metrics::dbusLatency);
+        return m_manager->moduleOutput(name, lines);
+    }
+
+    QStringList memoryUsage()
+    {
+        MetricsScope scope(Metrics::dbusLatency);
+        return m_manager->memoryUsage();
+    }
+
+    QStringList moduleResources()
+    {
+        MetricsScope scope(Metrics::dbusLatency);
+        return m_manager->moduleResources();
+    }
+
+    QStringList startupTimings()
+    {
+        MetricsScope scope(Metrics::dbusLatency);
+        return m_manager->startupTimings();
+    }
+
+    QStringList shortcutStats()
+    {
+        MetricsScope scope(Metrics::dbusLatency);
+        return m_shortcuts->stats();
+    }
+
+    QStringList sleepTimings()
+    {
+        MetricsScope scope(Metrics::dbusLatency);
+        return m_lockScreen->sleepTimings();
+    }
+
+    int logLevel()
+    {
+        return AsyncLogger::instance()->level();
+    }
+
+    Q_NOREPLY void setLogLevel(int level)
+    {
+        AsyncLogger::instance()->setLevel(level);
+    }
+
 private:
     GracefulModuleManager*          m_manager;
+    ShortcutManager*                m_shortcuts;
+    LockScreenManager*              m_lockScreen;
     graceful::Power                 m_power;
 };
 
@@ -0,0 +1,89 @@
+#include "session-environment.h"
+
+#include <graceful/log.h>
+
+#include <cctype>
+#include <cstring>
+
+/**
+* @brief expands $VAR, ${VAR} and a leading ~ (also after ':') without a shell.
+* Variables are looked up in block first, then in the process environment.
+* Quotes are removed like wordexp did: nothing is expanded between single
+* quotes, variables are expanded between double quotes; a backslash keeps
+* the next '$', '~', quote or backslash literal.
+**/
+QByteArray graceful_expand_env(const QByteArray &value, const QMap<QByteArray, QByteArray> &block)
+{
+    auto lookup = [&block](const QByteArray &name) {
+        return block.contains(name) ? block.value(name) : qgetenv(name.constData());
+    };
+
+    QByteArray out;
+    out.reserve(value.size());
+    const int n = value.size();
+    char quote = 0;
+    for (int i = 0; i < n; ++i) {
+        const char ch = value.at(i);
+        if (quote == '\'') {
+            if (ch == '\'')
+                quote = 0;
+            else
+                out += ch;
+            continue;
+        }
+
+        if (ch == '\\' && i + 1 < n && strchr("$~\\\"'", value.at(i + 1))) {
+            out += value.at(++i);
+            continue;
+        }
+
+        if (ch == '"' || (ch == '\'' && !quote)) {
+            quote = quote ? 0 : ch;
+            continue;
+        }
+
+        if (!quote && ch == '~' && (i == 0 || value.at(i - 1) == ':') && (i + 1 == n || value.at(i + 1) == '/' || value.at(i + 1) == ':')) {
+            out += lookup("HOME");
+            continue;
+        }
+
+        if (ch == '$' && i + 1 < n) {
+            if (value.at(i + 1) == '{') {
+                const int end = value.indexOf('}', i + 2);
+                if (end > i + 2) {
+                    out += lookup(value.mid(i + 2, end - i - 2));
+                    i = end;
+                    continue;
+                }
+            } else if (isalpha(static_cast<unsigned char>(value.at(i + 1))) || value.at(i + 1) == '_') {
+                int j = i + 1;
+                while (j < n && (isalnum(static_cast<unsigned char>(value.at(j))) || value.at(j) == '_'))
+                    ++j;
+                out += lookup(value.mid(i + 1, j - i - 1));
+                i = j - 1;
+                continue;
+            }
+        }
+
+        out += ch;
+    }
+
+    return out;
+}
+
+void graceful_setenv(const char *env, const QByteArray &value)
+{
+    const QByteArray expanded = graceful_expand_env(value);
+    log_debug("Environment variable %s=%s", env, expanded.constData());
+    qputenv(env, expanded);
+}
+
+void graceful_setenv_prepend(const char *env, const QByteArray &value, const QByteArray &separator)
+{
+    // only the new part is expanded, the current value is taken as it is
+    QByteArray orig(qgetenv(env));
+    orig = orig.prepend(separator);
+    orig = orig.prepend(graceful_expand_env(value));
+    log_debug("Setting special %s=%s", env, orig.toStdString().c_str());
+    qputenv(env, orig);
+}
@@ -0,0 +1,11 @@
+#ifndef SESSIONENVIRONMENT_H
+#define SESSIONENVIRONMENT_H
+
+#include <QByteArray>
+#include <QMap>
+
+QByteArray graceful_expand_env(const QByteArray &value, const QMap<QByteArray, QByteArray> &block = QMap<QByteArray, QByteArray>());
+void graceful_setenv(const char *env, const QByteArray &value);
+void graceful_setenv_prepend(const char *env, const QByteArray &value, const QByteArray &separator=":");
+
+#endif // SESSIONENVIRONMENT_H
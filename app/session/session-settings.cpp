@@ -0,0 +1,153 @@
+#include "session-settings.h"
+
+#include <graceful/log.h>
+#include <graceful/globals.h>
+#include <graceful/settings.h>
+
+#include <QFileSystemWatcher>
+#include <QFileInfo>
+#include <QFile>
+#include <QSet>
+
+#define GENERAL_GROUP           "General"
+#define RELOAD_DELAY_MS         200
+
+SessionSettings::SessionSettings(QObject *parent) :
+    QObject(parent),
+    mWatcher(new QFileSystemWatcher(this))
+{
+    // editors write the file in several steps, wait until they are done
+    mReloadTimer.setSingleShot(true);
+    mReloadTimer.setInterval(RELOAD_DELAY_MS);
+    connect(&mReloadTimer, &QTimer::timeout, this, &SessionSettings::reload);
+    connect(mWatcher, &QFileSystemWatcher::fileChanged, &mReloadTimer, QOverload<>::of(&QTimer::start));
+    connect(mWatcher, &QFileSystemWatcher::directoryChanged, &mReloadTimer, QOverload<>::of(&QTimer::start));
+}
+
+void SessionSettings::load(const QString &configName)
+{
+    mConfigName = configName;
+    mGroups = parse();
+    watch();
+}
+
+QString SessionSettings::fileName() const
+{
+    return mFileName;
+}
+
+QStringList SessionSettings::groups() const
+{
+    return mGroups.keys();
+}
+
+QStringList SessionSettings::keys(const QString &group) const
+{
+    QStringList ret;
+    const Group values = mGroups.value(group);
+    for (const QString &key : mKeyOrder.value(group)) {
+        if (values.contains(key) && !ret.contains(key))
+            ret << key;
+    }
+    // keys the raw scan could not match, e.g. with escaped characters
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        if (!ret.contains(it.key()))
+            ret << it.key();
+    }
+    return ret;
+}
+
+QVariant SessionSettings::value(const QString &group, const QString &key, const QVariant &defaultValue) const
+{
+    return mGroups.value(group).value(key, defaultValue);
+}
+
+SessionSettings::Groups SessionSettings::parse()
+{
+    graceful::Settings settings(mConfigName);
+    settings.sync();
+    mFileName = settings.fileName();
+
+    Groups groups;
+    const QStringList keys = settings.allKeys();
+    for (const QString &key : keys) {
+        const int sep = key.indexOf(QLatin1Char('/'));
+        if (sep < 0)
+            groups[QSL(GENERAL_GROUP)][key] = settings.value(key);
+        else
+            groups[key.left(sep)][key.mid(sep + 1)] = settings.value(key);
+    }
+
+    readKeyOrder();
+    return groups;
+}
+
+/**
+ * @brief remembers the order of the keys in the file, QSettings sorts them
+ */
+void SessionSettings::readKeyOrder()
+{
+    mKeyOrder.clear();
+
+    QFile file(mFileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return;
+
+    QString group = QSL(GENERAL_GROUP);
+    while (!file.atEnd()) {
+        const QString line = QString::fromUtf8(file.readLine()).trimmed();
+        if (line.isEmpty() || line.startsWith(QLatin1Char(';')) || line.startsWith(QLatin1Char('#')))
+            continue;
+        if (line.startsWith(QLatin1Char('[')) && line.endsWith(QLatin1Char(']'))) {
+            group = line.mid(1, line.size() - 2);
+            continue;
+        }
+        const int eq = line.indexOf(QLatin1Char('='));
+        if (eq > 0)
+            mKeyOrder[group] << line.left(eq).trimmed();
+    }
+}
+
+void SessionSettings::watch()
+{
+    // an atomic save replaces the file, so its directory is watched too
+    if (!mWatcher->files().isEmpty())
+        mWatcher->removePaths(mWatcher->files());
+    if (!mWatcher->directories().isEmpty())
+        mWatcher->removePaths(mWatcher->directories());
+
+    if (QFileInfo::exists(mFileName))
+        mWatcher->addPath(mFileName);
+    const QString dir = QFileInfo(mFileName).absolutePath();
+    if (QFileInfo::exists(dir))
+        mWatcher->addPath(dir);
+}
+
+void SessionSettings::reload()
+{
+    const Groups old = mGroups;
+    mGroups = parse();
+    watch();
+
+    QSet<QString> groupNames = QSet<QString>::fromList(old.keys());
+    groupNames.unite(QSet<QString>::fromList(mGroups.keys()));
+
+    for (const QString &group : qAsConst(groupNames)) {
+        const Group &before = old.value(group);
+        const Group &after = mGroups.value(group);
+        if (before == after)
+            continue;
+
+        QSet<QString> keys = QSet<QString>::fromList(before.keys());
+        keys.unite(QSet<QString>::fromList(after.keys()));
+
+        QStringList changed;
+        for (const QString &key : qAsConst(keys)) {
+            if (before.value(key) != after.value(key) || before.contains(key) != after.contains(key))
+                changed << key;
+        }
+
+        log_debug("Session settings group '%s' changed: %s", group.toUtf8().constData(), changed.join(QLatin1Char(',')).toUtf8().constData());
+        Q_EMIT groupChanged(group, changed);
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef SESSIONSETTINGS_H
+#define SESSIONSETTINGS_H
+
+#include <QObject>
+#include <QMap>
+#include <QTimer>
+#include <QVariant>
+#include <QStringList>
+
+class QFileSystemWatcher;
+
+/**
+ * @brief Parsed-once snapshot of the session configuration file.
+ *
+ * The file is watched, every modification produces a new snapshot which
+ * is compared with the previous one; groupChanged() is emitted once for
+ * every group with the keys that were added, removed or modified.
+ * Top level keys are stored in the "General" group, like QSettings does.
+ */
+class SessionSettings : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SessionSettings(QObject *parent = nullptr);
+
+    void load(const QString &configName);
+
+    QString fileName() const;
+    QStringList groups() const;
+    // in the order of the file, not sorted like QSettings
+    QStringList keys(const QString &group) const;
+    QVariant value(const QString &group, const QString &key, const QVariant &defaultValue = QVariant()) const;
+
+Q_SIGNALS:
+    void groupChanged(const QString &group, const QStringList &keys);
+
+private Q_SLOTS:
+    void reload();
+
+private:
+    typedef QMap<QString, QVariant>     Group;
+    typedef QMap<QString, Group>        Groups;
+
+    Groups parse();
+    void readKeyOrder();
+    void watch();
+
+private:
+    QString                 mConfigName;
+    QString                 mFileName;
+    Groups                  mGroups;
+    QMap<QString, QStringList> mKeyOrder;
+
+    QFileSystemWatcher*     mWatcher;
+    QTimer                  mReloadTimer;
+};
+
+#endif // SESSIONSETTINGS_H
@@ -1,42 +1,77 @@
 TEMPLATE    = app
 TARGET      = graceful-session
 
-QT          += core network gui gui-private xml widgets dbus x11extras KWindowSystem
+QT          += core gui xml dbus x11extras
 
 CONFIG      += c++11 link_pkgconfig no_keywords
 PKGCONFIG   += graceful gio-2.0 glib-2.0
-LIBS        += -lX11 -lprocps -lXss
+LIBS        += -lX11 -lprocps
 
 PKGCONFIG   += udev Qt5Xdg
+PKGCONFIG   += xcb xcb-xkb xcb-xinput xcb-sync
 include($$PWD/../common/common.pri)
 
 SOURCES     += \
     $$PWD/main.cpp                                      \
-    $$PWD/num-lock.cpp                                  \
+    $$PWD/input-settings.cpp                            \
+    $$PWD/session-settings.cpp                          \
+    $$PWD/session-environment.cpp                       \
+    $$PWD/settings-snapshot.cpp                         \
+    $$PWD/startup-timings.cpp                           \
+    $$PWD/startup-history.cpp                           \
+    $$PWD/metrics.cpp                                   \
+    $$PWD/metrics-server.cpp                            \
+    $$PWD/session-bootstrap.cpp                         \
+    $$PWD/async-logger.cpp                              \
+    $$PWD/module-output.cpp                             \
+    $$PWD/error-notifier.cpp                            \
+    $$PWD/udev-monitor.cpp                              \
+    $$PWD/input-device-watcher.cpp                      \
+    $$PWD/power-source-watcher.cpp                      \
     $$PWD/proc-reaper.cpp                               \
+    $$PWD/process-tree.cpp                              \
+    $$PWD/memory-monitor.cpp                            \
     $$PWD/window-manager.cpp                            \
+    $$PWD/x11-utils.cpp                                 \
     $$PWD/graceful-modman.cpp                           \
-    $$PWD/wm-select-dialog.cpp                          \
+    $$PWD/shortcut-manager.cpp                          \
+    $$PWD/idle-watcher.cpp                              \
     $$PWD/lock-screen-manager.cpp                       \
     $$PWD/session-application.cpp                       \
     $$PWD/session-dbus-adaptor.cpp                      \
 
 
 HEADERS     += \
-    $$PWD/num-lock.h                                    \
+    $$PWD/input-settings.h                              \
+    $$PWD/session-settings.h                            \
+    $$PWD/session-environment.h                         \
+    $$PWD/settings-snapshot.h                           \
+    $$PWD/settings-snapshot-format.h                    \
+    $$PWD/startup-timings.h                             \
+    $$PWD/startup-history.h                             \
+    $$PWD/metrics.h                                     \
+    $$PWD/metrics-server.h                              \
+    $$PWD/session-bootstrap.h                           \
+    $$PWD/async-logger.h                                \
+    $$PWD/module-output.h                               \
+    $$PWD/error-notifier.h                              \
+    $$PWD/log-record-format.h                           \
+    $$PWD/udev-monitor.h                                \
+    $$PWD/input-device-watcher.h                        \
+    $$PWD/power-source-watcher.h                        \
     $$PWD/proc-reaper.h                                 \
+    $$PWD/process-tree.h                                \
+    $$PWD/memory-monitor.h                              \
     $$PWD/window-manager.h                              \
+    $$PWD/x11-utils.h                                   \
     $$PWD/graceful-modman.h                             \
-    $$PWD/wm-select-dialog.h                            \
+    $$PWD/shortcut-manager.h                            \
+    $$PWD/idle-watcher.h                                \
     $$PWD/lock-screen-manager.h                         \
     $$PWD/session-application.h                         \
     $$PWD/session-dbus-adaptor.h                        \
 
 
-FORMS       += \
-    $$PWD/wm-select-dialog.ui
-
-
 OTHER_FILES += \
     $$PWD/data/graceful-session.desktop                 \
     $$PWD/data/start-graceful-session                   \
@@ -60,4 +95,8 @@ GRACEFUL_SESSION_TARGET.files += \
 GRACEFUL_SESSION_TARGET.path = /usr/bin/
 
 
-INSTALLS += GRACEFUL_SESSION_TARGET GRACEFUL_WM GRACEFUL_SESSION_DESKTOP
+GRACEFUL_SESSION_HEADERS.files = $$PWD/settings-snapshot-format.h
+GRACEFUL_SESSION_HEADERS.path = /usr/include/graceful-session/
+
+
+INSTALLS += GRACEFUL_SESSION_TARGET GRACEFUL_WM GRACEFUL_SESSION_DESKTOP GRACEFUL_SESSION_HEADERS
@@ -0,0 +1,34 @@
+#ifndef SETTINGSSNAPSHOTFORMAT_H
+#define SETTINGSSNAPSHOTFORMAT_H
+
+/**
+ * Layout of the settings snapshot published by graceful-session.
+ *
+ * The file is named by $GRACEFUL_SESSION_SNAPSHOT and is read-only for the
+ * modules, which are expected to mmap() it. After the header come `count`
+ * entries, each one made of three NUL terminated UTF-8 strings:
+ *   section, key, value
+ * Sections are "session/<group>" for the session configuration, "theme"
+ * and "environment".
+ *
+ * A newer snapshot is written to a new file which atomically replaces the
+ * old one; afterwards the `generation` of the replaced file is raised to
+ * the new value. A reader therefore only compares the generation it saw
+ * when mapping the file and reopens the path once it differs.
+ */
+
+#include <stdint.h>
+
+#define GRACEFUL_SNAPSHOT_MAGIC         "GSSNAPSH"
+#define GRACEFUL_SNAPSHOT_VERSION       1
+
+struct graceful_snapshot_header
+{
+    char            magic[8];
+    uint32_t        version;
+    uint32_t        count;
+    uint64_t        generation;     // read with an atomic load
+    uint64_t        size;           // size of the whole file
+};
+
+#endif // SETTINGSSNAPSHOTFORMAT_H
@@ -0,0 +1,161 @@
+#include "settings-snapshot.h"
+
+#include "session-settings.h"
+#include "settings-snapshot-format.h"
+
+#include <graceful/log.h>
+#include <graceful/globals.h>
+#include <graceful/settings.h>
+
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+#include <QProcessEnvironment>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <cerrno>
+
+static void append_entry(QByteArray &data, const QString &section, const QString &key, const QString &value)
+{
+    data += section.toUtf8();
+    data += '\0';
+    data += key.toUtf8();
+    data += '\0';
+    data += value.toUtf8();
+    data += '\0';
+}
+
+SettingsSnapshot::SettingsSnapshot() :
+    mGeneration(0),
+    mMapped(nullptr),
+    mMappedSize(0)
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + QSL("/graceful-session");
+    QDir().mkpath(dir);
+    mPath = dir + QSL("/settings.snapshot");
+}
+
+SettingsSnapshot::~SettingsSnapshot()
+{
+    unmap();
+}
+
+QString SettingsSnapshot::path() const
+{
+    return mPath;
+}
+
+uint64_t SettingsSnapshot::generation() const
+{
+    return mGeneration;
+}
+
+bool SettingsSnapshot::publish(const SessionSettings &settings)
+{
+    // continue the generation of a file left by a previous instance
+    if (!mMapped) {
+        QFile old(mPath);
+        graceful_snapshot_header header;
+        if (old.open(QIODevice::ReadOnly) && old.read(reinterpret_cast<char*>(&header), sizeof(header)) == sizeof(header)
+            && memcmp(header.magic, GRACEFUL_SNAPSHOT_MAGIC, sizeof(header.magic)) == 0) {
+            mGeneration = header.generation;
+        }
+    }
+
+    QByteArray data;
+    uint32_t count = 0;
+    const QStringList groups = settings.groups();
+    for (const QString &group : groups) {
+        const QStringList keys = settings.keys(group);
+        for (const QString &key : keys) {
+            const QVariant value = settings.value(group, key);
+            const QString str = value.type() == QVariant::StringList ? value.toStringList().join(QLatin1Char(',')) : value.toString();
+            append_entry(data, QSL("session/") + group, key, str);
+            ++count;
+        }
+    }
+
+    append_entry(data, QSL("theme"), QSL("name"), gracefulTheme.currentTheme().name());
+    append_entry(data, QSL("theme"), QSL("path"), gracefulTheme.currentTheme().path());
+    count += 2;
+
+    const QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    const QStringList envKeys = env.keys();
+    for (const QString &key : envKeys) {
+        append_entry(data, QSL("environment"), key, env.value(key));
+        ++count;
+    }
+
+    graceful_snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GRACEFUL_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = GRACEFUL_SNAPSHOT_VERSION;
+    header.count = count;
+    header.generation = mGeneration + 1;
+    header.size = sizeof(header) + data.size();
+    data.prepend(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // the runtime dir is a tmpfs, replacing the file is all the durability needed
+    const QByteArray tmpPath = QFile::encodeName(mPath + QSL(".tmp"));
+    ::unlink(tmpPath.constData());
+    int fd = ::open(tmpPath.constData(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0444);
+    if (fd < 0) {
+        log_warn("Unable to create %s: %s", tmpPath.constData(), strerror(errno));
+        return false;
+    }
+
+    const char* p = data.constData();
+    qint64 left = data.size();
+    while (left > 0) {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            log_warn("Unable to write %s: %s", tmpPath.constData(), strerror(errno));
+            ::close(fd);
+            ::unlink(tmpPath.constData());
+            return false;
+        }
+        p += n;
+        left -= n;
+    }
+
+    void* mapped = ::mmap(nullptr, data.size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (::rename(tmpPath.constData(), QFile::encodeName(mPath).constData()) != 0) {
+        log_warn("Unable to publish %s: %s", mPath.toUtf8().constData(), strerror(errno));
+        if (mapped != MAP_FAILED)
+            ::munmap(mapped, data.size());
+        ::unlink(tmpPath.constData());
+        return false;
+    }
+
+    // readers of the replaced file notice the new generation and reopen the path
+    ++mGeneration;
+    if (mMapped)
+        __atomic_store_n(&static_cast<graceful_snapshot_header*>(mMapped)->generation, mGeneration, __ATOMIC_RELEASE);
+    unmap();
+
+    if (mapped != MAP_FAILED) {
+        mMapped = mapped;
+        mMappedSize = data.size();
+    }
+
+    log_debug("Settings snapshot %s generation %llu, %u entries", mPath.toUtf8().constData(),
+              static_cast<unsigned long long>(mGeneration), count);
+    return true;
+}
+
+void SettingsSnapshot::unmap()
+{
+    if (mMapped) {
+        ::munmap(mMapped, mMappedSize);
+        mMapped = nullptr;
+        mMappedSize = 0;
+    }
+}
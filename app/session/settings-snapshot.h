@@ -0,0 +1,36 @@
+#ifndef SETTINGSSNAPSHOT_H
+#define SETTINGSSNAPSHOT_H
+
+#include <QString>
+#include <QByteArray>
+#include <stdint.h>
+
+class SessionSettings;
+
+/**
+ * @brief Publishes the effective settings as a binary, mmap-able file.
+ *
+ * See settings-snapshot-format.h for the layout the modules read.
+ */
+class SettingsSnapshot
+{
+public:
+    SettingsSnapshot();
+    ~SettingsSnapshot();
+
+    QString path() const;
+    uint64_t generation() const;
+
+    bool publish(const SessionSettings &settings);
+
+private:
+    void unmap();
+
+private:
+    QString         mPath;
+    uint64_t        mGeneration;
+    void*           mMapped;
+    size_t          mMappedSize;
+};
+
+#endif // SETTINGSSNAPSHOT_H
@@ -0,0 +1,102 @@
+#include "shortcut-manager.h"
+
+#include "session-settings.h"
+#include "graceful-modman.h"
+
+#include <graceful/log.h>
+#include <graceful/globals.h>
+#include <graceful/qhotkey.h>
+
+#include <QProcess>
+#include <QStandardPaths>
+#include <QElapsedTimer>
+#include <QKeySequence>
+
+#define SHORTCUTS_GROUP "Shortcuts"
+
+ShortcutManager::ShortcutManager(GracefulModuleManager *modman, QObject *parent) :
+    QObject(parent),
+    mModman(modman)
+{
+}
+
+ShortcutManager::~ShortcutManager()
+{
+    for (const Shortcut &shortcut : qAsConst(mShortcuts))
+        delete shortcut.hotkey;
+}
+
+void ShortcutManager::load(const SessionSettings &settings)
+{
+    QHash<QString, QString> table;
+    const QStringList keys = settings.keys(QSL(SHORTCUTS_GROUP));
+    for (const QString &key : keys)
+        table[key] = settings.value(QSL(SHORTCUTS_GROUP), key).toString();
+
+    // the shortcut graceful-session always had
+    if (!settings.groups().contains(QSL(SHORTCUTS_GROUP)))
+        table[QSL("ctrl+alt+t")] = QSL("gnome-terminal");
+
+    // drop what is gone or changed, unchanged hotkeys stay registered
+    for (auto it = mShortcuts.begin(); it != mShortcuts.end();) {
+        if (table.value(it.key()) != it->command) {
+            delete it->hotkey;
+            it = mShortcuts.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto it = table.constBegin(); it != table.constEnd(); ++it) {
+        const QString &sequence = it.key();
+        if (mShortcuts.contains(sequence) || it.value().isEmpty())
+            continue;
+
+        QStringList args = QProcess::splitCommand(it.value());
+        const QString program = args.isEmpty() ? QString() : QStandardPaths::findExecutable(args.takeFirst());
+        if (program.isEmpty()) {
+            log_warn("shortcut %s: '%s' not found", sequence.toUtf8().constData(), it.value().toUtf8().constData());
+            continue;
+        }
+
+        QHotkey* hotkey = new QHotkey(QKeySequence(sequence), true, this);
+        if (!hotkey->isRegistered())
+            log_warn("shortcut %s could not be grabbed", sequence.toUtf8().constData());
+        connect(hotkey, &QHotkey::activated, this, [this, sequence] { activate(sequence); });
+
+        mShortcuts.insert(sequence, Shortcut{it.value(), program, args, hotkey, 0, 0, 0});
+        log_debug("shortcut %s -> %s", sequence.toUtf8().constData(), program.toUtf8().constData());
+    }
+}
+
+void ShortcutManager::activate(const QString &sequence)
+{
+    auto it = mShortcuts.find(sequence);
+    if (it == mShortcuts.end())
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+    const qint64 pid = mModman->spawn(it->program, it->args);
+    const qint64 us = timer.nsecsElapsed() / 1000;
+
+    if (pid < 0)
+        return;
+
+    ++it->launches;
+    it->totalSpawnUs += us;
+    it->maxSpawnUs = qMax(it->maxSpawnUs, us);
+    log_debug("shortcut %s spawned %s (pid %lld) in %lld us", sequence.toUtf8().constData(),
+              it->program.toUtf8().constData(), pid, us);
+}
+
+QStringList ShortcutManager::stats() const
+{
+    QStringList ret;
+    for (auto it = mShortcuts.constBegin(); it != mShortcuts.constEnd(); ++it) {
+        const qint64 mean = it->launches ? it->totalSpawnUs / qint64(it->launches) : 0;
+        ret << QSL("%1 %2 %3 %4").arg(it.key()).arg(it->launches).arg(mean).arg(it->maxSpawnUs);
+    }
+
+    return ret;
+}
@@ -0,0 +1,52 @@
+#ifndef SHORTCUTMANAGER_H
+#define SHORTCUTMANAGER_H
+
+#include <QObject>
+#include <QHash>
+#include <QStringList>
+
+class QHotkey;
+class SessionSettings;
+class GracefulModuleManager;
+
+/**
+ * @brief Global shortcuts from the [Shortcuts] group.
+ *
+ * Every entry maps a key sequence to a command line, e.g.
+ * ctrl+alt+t=gnome-terminal. The program is looked up in PATH when the
+ * table is loaded, a key press only spawns it.
+ */
+class ShortcutManager : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ShortcutManager(GracefulModuleManager *modman, QObject *parent = nullptr);
+    ~ShortcutManager() override;
+
+    void load(const SessionSettings &settings);
+
+    // one line per shortcut: sequence, launches, mean and max spawn latency
+    // in us, i.e. how long spawn() took; the time since the key press is not
+    // known, QHotkey does not pass the event on
+    QStringList stats() const;
+
+private:
+    struct Shortcut {
+        QString     command;
+        QString     program;
+        QStringList args;
+        QHotkey*    hotkey;
+
+        quint64     launches;
+        qint64      totalSpawnUs;
+        qint64      maxSpawnUs;
+    };
+
+    void activate(const QString &sequence);
+
+private:
+    GracefulModuleManager*      mModman;
+    QHash<QString, Shortcut>    mShortcuts;
+};
+
+#endif // SHORTCUTMANAGER_H
@@ -0,0 +1,157 @@
+#include "startup-history.h"
+
+#include <graceful/log.h>
+#include <graceful/globals.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#define SAMPLE_INTERVAL_MS      100
+// below one tick (10 ms) per sample the module is considered idle
+#define QUIET_TICKS             1
+#define QUIET_SAMPLES           3
+#define MAX_READY_MS            (15 * 1000)
+// weight of the newest login in the average
+#define HISTORY_WEIGHT          0.3
+
+/**
+* @brief utime + stime of pid in clock ticks, -1 once it is gone
+**/
+static qint64 cpu_ticks(qint64 pid)
+{
+    QFile file(QSL("/proc/%1/stat").arg(pid));
+    if (!file.open(QIODevice::ReadOnly))
+        return -1;
+
+    // the command may contain spaces, the fields start after the last ')'
+    const QByteArray stat = file.readAll();
+    const QList<QByteArray> fields = stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+    // state is field 3 of stat(5), utime and stime are 14 and 15
+    if (fields.size() < 13)
+        return -1;
+
+    return fields.at(11).toLongLong() + fields.at(12).toLongLong();
+}
+
+StartupHistory::StartupHistory(QObject *parent) :
+    QObject(parent)
+{
+    mSampleTimer.setInterval(SAMPLE_INTERVAL_MS);
+    connect(&mSampleTimer, &QTimer::timeout, this, &StartupHistory::sample);
+}
+
+QString StartupHistory::path() const
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QSL("/graceful-session/startup-history.json");
+}
+
+void StartupHistory::load()
+{
+    QFile file(path());
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    for (auto it = root.constBegin(); it != root.constEnd(); ++it)
+        mPredicted[it.key()] = static_cast<qint64>(it.value().toDouble(-1));
+
+    mLearned = mPredicted;
+}
+
+qint64 StartupHistory::predicted(const QString &name) const
+{
+    return mPredicted.value(name, -1);
+}
+
+void StartupHistory::track(const QString &name, qint64 pid)
+{
+    if (pid <= 0 || mActual.contains(name) || mProbes.contains(name))
+        return;
+
+    Probe probe;
+    probe.pid = pid;
+    probe.timer.start();
+    probe.cpuTicks = cpu_ticks(pid);
+    probe.quietSamples = 0;
+    mProbes.insert(name, probe);
+
+    if (!mSampleTimer.isActive())
+        mSampleTimer.start();
+}
+
+void StartupHistory::sample()
+{
+    QList<QPair<QString, qint64>> finished;
+
+    for (auto it = mProbes.begin(); it != mProbes.end(); ++it) {
+        Probe &probe = it.value();
+        const qint64 ticks = cpu_ticks(probe.pid);
+        const qint64 elapsed = probe.timer.elapsed();
+
+        if (ticks < 0 || elapsed >= MAX_READY_MS) {
+            finished << qMakePair(it.key(), elapsed);
+            continue;
+        }
+
+        probe.quietSamples = ticks - probe.cpuTicks <= QUIET_TICKS ? probe.quietSamples + 1 : 0;
+        probe.cpuTicks = ticks;
+
+        // ready when the quiet period began
+        if (probe.quietSamples >= QUIET_SAMPLES)
+            finished << qMakePair(it.key(), qMax<qint64>(0, elapsed - QUIET_SAMPLES * SAMPLE_INTERVAL_MS));
+    }
+
+    for (const auto &module : qAsConst(finished))
+        finish(module.first, module.second);
+
+    if (mProbes.isEmpty()) {
+        mSampleTimer.stop();
+        save();
+    }
+}
+
+void StartupHistory::finish(const QString &name, qint64 ms)
+{
+    mProbes.remove(name);
+    mActual[name] = ms;
+
+    const qint64 old = mLearned.value(name, -1);
+    mLearned[name] = old < 0 ? ms : static_cast<qint64>(HISTORY_WEIGHT * ms + (1 - HISTORY_WEIGHT) * old);
+    log_debug("module %s ready after %lld ms (predicted %lld)", name.toUtf8().constData(), ms, predicted(name));
+}
+
+void StartupHistory::save() const
+{
+    QJsonObject root;
+    for (auto it = mLearned.constBegin(); it != mLearned.constEnd(); ++it)
+        root[it.key()] = static_cast<double>(it.value());
+
+    const QString fileName = path();
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        log_error("unable to write %s", fileName.toUtf8().constData());
+        return;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    if (!file.commit())
+        log_error("unable to write %s", fileName.toUtf8().constData());
+}
+
+QStringList StartupHistory::report() const
+{
+    QStringList names = mPredicted.keys() + mActual.keys() + mProbes.keys();
+    names.removeDuplicates();
+    names.sort();
+
+    QStringList ret;
+    for (const QString &name : qAsConst(names))
+        ret << QSL("%1 %2 %3").arg(name).arg(predicted(name)).arg(mActual.value(name, -1));
+
+    return ret;
+}
@@ -0,0 +1,57 @@
+#ifndef STARTUPHISTORY_H
+#define STARTUPHISTORY_H
+
+#include <QObject>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QStringList>
+
+/**
+ * @brief Per module readiness times, remembered across logins.
+ *
+ * A module counts as ready once its CPU use settled down after the start.
+ * The times of earlier logins are averaged (EWMA) and used to predict the
+ * cost of the next start.
+ */
+class StartupHistory : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StartupHistory(QObject *parent = nullptr);
+
+    QString path() const;
+    void load();
+
+    // ms, -1 if the module was never measured
+    qint64 predicted(const QString &name) const;
+
+    // measures the first start of name in this session
+    void track(const QString &name, qint64 pid);
+
+    // one line per module: name, predicted and actual ms (-1 if unknown)
+    QStringList report() const;
+
+private Q_SLOTS:
+    void sample();
+
+private:
+    struct Probe {
+        qint64          pid;
+        QElapsedTimer   timer;
+        qint64          cpuTicks;
+        int             quietSamples;
+    };
+
+    void finish(const QString &name, qint64 ms);
+    void save() const;
+
+private:
+    QHash<QString, qint64>      mPredicted;
+    QHash<QString, qint64>      mLearned;
+    QHash<QString, qint64>      mActual;
+    QHash<QString, Probe>       mProbes;
+    QTimer                      mSampleTimer;
+};
+
+#endif // STARTUPHISTORY_H
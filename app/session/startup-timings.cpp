@@ -0,0 +1,50 @@
+#include "startup-timings.h"
+
+#include <graceful/log.h>
+
+#include <QFile>
+
+StartupTimings::PhaseList StartupTimings::sPhases;
+
+void StartupTimings::record(const QString &phase, qint64 ms)
+{
+    sPhases << qMakePair(phase, ms);
+}
+
+StartupTimings::PhaseList StartupTimings::phases()
+{
+    return sPhases;
+}
+
+qint64 StartupTimings::residentMemory()
+{
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (!status.open(QIODevice::ReadOnly))
+        return -1;
+
+    // "VmRSS:     12345 kB"
+    for (QByteArray line = status.readLine(); !line.isEmpty(); line = status.readLine()) {
+        if (line.startsWith("VmRSS:"))
+            return line.mid(6).trimmed().split(' ').first().toLongLong();
+    }
+
+    return -1;
+}
+
+void StartupTimings::dump()
+{
+    for (const auto &phase : qAsConst(sPhases))
+        log_info("startup phase %s: %lld ms", phase.first.toUtf8().constData(), phase.second);
+    log_info("resident memory after startup: %lld kB", residentMemory());
+}
+
+StartupTimings::Phase::Phase(const QString &name) :
+    mName(name)
+{
+    mTimer.start();
+}
+
+StartupTimings::Phase::~Phase()
+{
+    StartupTimings::record(mName, mTimer.elapsed());
+}
@@ -0,0 +1,41 @@
+#ifndef STARTUPTIMINGS_H
+#define STARTUPTIMINGS_H
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QElapsedTimer>
+
+/**
+ * @brief Durations of the login phases, in milliseconds.
+ */
+class StartupTimings
+{
+public:
+    typedef QList<QPair<QString, qint64>> PhaseList;
+
+    static void record(const QString &phase, qint64 ms);
+    static PhaseList phases();
+    static void dump();
+    // VmRSS in kB, -1 if unknown
+    static qint64 residentMemory();
+
+    /**
+     * @brief Records the time between its construction and destruction.
+     */
+    class Phase
+    {
+    public:
+        explicit Phase(const QString &name);
+        ~Phase();
+
+    private:
+        QString         mName;
+        QElapsedTimer   mTimer;
+    };
+
+private:
+    static PhaseList    sPhases;
+};
+
+#endif // STARTUPTIMINGS_H
@@ -0,0 +1,59 @@
+#include "udev-monitor.h"
+
+#include <graceful/log.h>
+
+#include <QSocketNotifier>
+#include <libudev.h>
+
+UdevMonitor::UdevMonitor(const char *subsystem, QObject *parent) :
+    QObject(parent),
+    mUdev(udev_new()),
+    mMonitor(nullptr),
+    mNotifier(nullptr)
+{
+    if (!mUdev) {
+        log_warn("udev_new failed, '%s' devices are not monitored", subsystem);
+        return;
+    }
+
+    mMonitor = udev_monitor_new_from_netlink(mUdev, "udev");
+    if (!mMonitor) {
+        log_warn("Unable to create udev monitor for '%s'", subsystem);
+        return;
+    }
+
+    udev_monitor_filter_add_match_subsystem_devtype(mMonitor, subsystem, nullptr);
+    if (udev_monitor_enable_receiving(mMonitor) < 0) {
+        log_warn("Unable to receive udev events for '%s'", subsystem);
+        udev_monitor_unref(mMonitor);
+        mMonitor = nullptr;
+        return;
+    }
+
+    mNotifier = new QSocketNotifier(udev_monitor_get_fd(mMonitor), QSocketNotifier::Read, this);
+    connect(mNotifier, &QSocketNotifier::activated, this, &UdevMonitor::readEvents);
+}
+
+UdevMonitor::~UdevMonitor()
+{
+    delete mNotifier;
+    if (mMonitor)
+        udev_monitor_unref(mMonitor);
+    if (mUdev)
+        udev_unref(mUdev);
+}
+
+bool UdevMonitor::isValid() const
+{
+    return mNotifier != nullptr;
+}
+
+void UdevMonitor::readEvents()
+{
+    while (struct udev_device* dev = udev_monitor_receive_device(mMonitor)) {
+        const char* action = udev_device_get_action(dev);
+        const char* sysPath = udev_device_get_syspath(dev);
+        Q_EMIT deviceChanged(QString::fromLatin1(action ? action : ""), QString::fromUtf8(sysPath ? sysPath : ""));
+        udev_device_unref(dev);
+    }
+}
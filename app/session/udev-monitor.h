@@ -0,0 +1,34 @@
+#ifndef UDEVMONITOR_H
+#define UDEVMONITOR_H
+
+#include <QObject>
+
+struct udev;
+struct udev_monitor;
+class QSocketNotifier;
+
+/**
+ * @brief Delivers udev uevents of one subsystem on the Qt event loop.
+ */
+class UdevMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    explicit UdevMonitor(const char *subsystem, QObject *parent = nullptr);
+    ~UdevMonitor() override;
+
+    bool isValid() const;
+
+Q_SIGNALS:
+    void deviceChanged(const QString &action, const QString &sysPath);
+
+private Q_SLOTS:
+    void readEvents();
+
+private:
+    struct udev*            mUdev;
+    struct udev_monitor*    mMonitor;
+    QSocketNotifier*        mNotifier;
+};
+
+#endif // UDEVMONITOR_H
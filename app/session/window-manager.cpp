@@ -7,21 +7,30 @@
 #include <graceful/globals.h>
 #include <graceful/settings.h>
 #include <QDebug>
+#include <unistd.h>
 
 
 bool findProgram(const QString &program)
 {
-    QFileInfo fi(program);
-    if (!program.isEmpty() && fi.isExecutable()) {
+    if (program.isEmpty())
+        return false;
+
+    // access() instead of QFileInfo: no stat cache objects, no string joins
+    const QByteArray name = QFile::encodeName(program);
+    if (::access(name.constData(), X_OK) == 0)
         return true;
-    }
 
-    const QStringList paths = QFile::decodeName(qgetenv("PATH")).split(':') << "/usr/local/bin/";
-    for(const QString &dir : paths) {
-        QFileInfo fi= QFileInfo(dir + QDir::separator() + program);
-        if (fi.isExecutable()) {
+    QByteArray path = qgetenv("PATH");
+    path += ":/usr/local/bin";
+    QByteArray candidate;
+    for (const QByteArray &dir : path.split(':')) {
+        if (dir.isEmpty())
+            continue;
+        candidate = dir;
+        candidate += '/';
+        candidate += name;
+        if (::access(candidate.constData(), X_OK) == 0)
             return true;
-        }
     }
 
     return false;
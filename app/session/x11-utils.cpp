@@ -0,0 +1,133 @@
+#include "x11-utils.h"
+
+#include <QX11Info>
+#include <QByteArray>
+
+#include <xcb/xcb.h>
+#include <cstdlib>
+
+enum {
+    AtomWmCheck,
+    AtomWmName,
+    AtomTray,
+    AtomManager,
+    AtomCount
+};
+
+/**
+ * The atoms never change during the session, they are interned once and
+ * with a single round trip.
+ */
+static const xcb_atom_t* intern_atoms(xcb_connection_t* c)
+{
+    static xcb_atom_t atoms[AtomCount] = {XCB_ATOM_NONE, XCB_ATOM_NONE, XCB_ATOM_NONE, XCB_ATOM_NONE};
+
+    if (atoms[AtomWmCheck] == XCB_ATOM_NONE) {
+        const QByteArray trayName = "_NET_SYSTEM_TRAY_S" + QByteArray::number(QX11Info::appScreen());
+        const QByteArray names[AtomCount] = {"_NET_SUPPORTING_WM_CHECK", "_NET_WM_NAME", trayName, "MANAGER"};
+
+        xcb_intern_atom_cookie_t cookies[AtomCount];
+        for (int i = 0; i < AtomCount; ++i)
+            cookies[i] = xcb_intern_atom(c, false, names[i].length(), names[i].constData());
+
+        for (int i = 0; i < AtomCount; ++i) {
+            xcb_intern_atom_reply_t* reply = xcb_intern_atom_reply(c, cookies[i], nullptr);
+            if (reply) {
+                atoms[i] = reply->atom;
+                free(reply);
+            }
+        }
+    }
+
+    for (int i = 0; i < AtomCount; ++i) {
+        if (atoms[i] == XCB_ATOM_NONE)
+            return nullptr;
+    }
+    return atoms;
+}
+
+static xcb_window_t supporting_wm_check(xcb_connection_t* c, xcb_window_t window, xcb_atom_t wmCheck)
+{
+    xcb_window_t ret = XCB_WINDOW_NONE;
+    xcb_get_property_reply_t* reply = xcb_get_property_reply(c,
+            xcb_get_property(c, false, window, wmCheck, XCB_ATOM_WINDOW, 0, 1), nullptr);
+    if (reply) {
+        if (reply->type == XCB_ATOM_WINDOW && xcb_get_property_value_length(reply) == sizeof(xcb_window_t))
+            ret = *static_cast<xcb_window_t*>(xcb_get_property_value(reply));
+        free(reply);
+    }
+
+    return ret;
+}
+
+bool x11_window_manager_running()
+{
+    if (!QX11Info::isPlatformX11())
+        return false;
+
+    xcb_connection_t* c = QX11Info::connection();
+    const xcb_atom_t* atoms = intern_atoms(c);
+    if (!atoms)
+        return false;
+
+    const xcb_window_t check = supporting_wm_check(c, QX11Info::appRootWindow(), atoms[AtomWmCheck]);
+    if (check == XCB_WINDOW_NONE)
+        return false;
+
+    // a stale property of a dead window manager does not point back to itself
+    if (supporting_wm_check(c, check, atoms[AtomWmCheck]) != check)
+        return false;
+
+    bool ret = false;
+    xcb_get_property_reply_t* reply = xcb_get_property_reply(c,
+            xcb_get_property(c, false, check, atoms[AtomWmName], XCB_GET_PROPERTY_TYPE_ANY, 0, 64), nullptr);
+    if (reply) {
+        ret = xcb_get_property_value_length(reply) > 0;
+        free(reply);
+    }
+
+    return ret;
+}
+
+bool x11_system_tray_running()
+{
+    if (!QX11Info::isPlatformX11())
+        return false;
+
+    xcb_connection_t* c = QX11Info::connection();
+    const xcb_atom_t* atoms = intern_atoms(c);
+    if (!atoms)
+        return false;
+
+    bool ret = false;
+    xcb_get_selection_owner_reply_t* reply = xcb_get_selection_owner_reply(c, xcb_get_selection_owner(c, atoms[AtomTray]), nullptr);
+    if (reply) {
+        ret = reply->owner != XCB_WINDOW_NONE;
+        free(reply);
+    }
+
+    return ret;
+}
+
+bool x11_window_manager_event(const void* message)
+{
+    const xcb_generic_event_t* event = static_cast<const xcb_generic_event_t*>(message);
+    if ((event->response_type & ~0x80) != XCB_PROPERTY_NOTIFY)
+        return false;
+
+    const xcb_atom_t* atoms = intern_atoms(QX11Info::connection());
+    const xcb_property_notify_event_t* notify = reinterpret_cast<const xcb_property_notify_event_t*>(event);
+    return atoms && notify->window == QX11Info::appRootWindow() && notify->atom == atoms[AtomWmCheck];
+}
+
+bool x11_system_tray_event(const void* message)
+{
+    const xcb_generic_event_t* event = static_cast<const xcb_generic_event_t*>(message);
+    if ((event->response_type & ~0x80) != XCB_CLIENT_MESSAGE)
+        return false;
+
+    const xcb_atom_t* atoms = intern_atoms(QX11Info::connection());
+    const xcb_client_message_event_t* client = reinterpret_cast<const xcb_client_message_event_t*>(event);
+    return atoms && client->type == atoms[AtomManager] && client->format == 32
+            && client->data.data32[1] == atoms[AtomTray];
+}
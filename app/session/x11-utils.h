@@ -0,0 +1,26 @@
+#ifndef X11UTILS_H
+#define X11UTILS_H
+
+/**
+ * @brief true once a window manager announced itself through
+ * _NET_SUPPORTING_WM_CHECK and set _NET_WM_NAME on its check window.
+ */
+bool x11_window_manager_running();
+
+/**
+ * @brief true while someone owns the _NET_SYSTEM_TRAY_S<screen> selection.
+ */
+bool x11_system_tray_running();
+
+/**
+ * @brief true for the change of _NET_SUPPORTING_WM_CHECK on the root window,
+ * the only event after which x11_window_manager_running() may change.
+ */
+bool x11_window_manager_event(const void* message);
+
+/**
+ * @brief true for the MANAGER message of a new _NET_SYSTEM_TRAY_S<screen> owner.
+ */
+bool x11_system_tray_event(const void* message);
+
+#endif // X11UTILS_H
@@ -1,4 +1,9 @@
 TEMPLATE = subdirs
 
 SUBDIRS = \
-    $$PWD/app/session
+    $$PWD/app/session \
+    $$PWD/app/session-ui \
+    $$PWD/app/session-logdump \
+    $$PWD/app/session-bench \
+    $$PWD/app/session-stress-stub \
+    $$PWD/app/session-stress